@@ -0,0 +1,265 @@
+// Tests for the dump container, run by "make test" under AddressSanitizer
+// and UBSan. The dumper is compiled in whole, with its main renamed, so
+// the codec and reader are called directly.
+//
+// - lz_compress / lz_decompress round trips over generated blocks: random
+//   bytes, a few distinct bytes, zeros, and text-like data with repeats.
+//   Every compressed block is decoded again with a bit flipped and cut
+//   short; that must fail or succeed, but stay inside the buffers, which
+//   are allocated to their exact sizes so ASan sees any overrun.
+// - A container written from a raw file reads back byte for byte. Copies
+//   with random bytes overwritten must then either be refused by
+//   container_open or read back without faults.
+
+#define main memory_dumper_main
+#include "memory_dumper.c"
+#undef main
+
+#define LZ_CASES 20000
+#define CORRUPT_CASES 2000
+#define TEST_BASE 0x10000000UL
+#define TEST_SIZE (5 * CONTAINER_BLOCK_SIZE + 4096)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void fill_block(unsigned char *buf, size_t len, int kind) {
+    for (size_t i = 0; i < len; i++) {
+        switch (kind) {
+        case 0: buf[i] = rng(); break;
+        case 1: buf[i] = rng() % 3; break;
+        case 2: buf[i] = 0; break;
+        default: buf[i] = (i % 17 == 0 || i == 0) ? 'a' + rng() % 26 : buf[i - 1]; break;
+        }
+    }
+    // Copies from earlier in the block give the matcher long matches
+    for (int k = 0; kind == 3 && len > 400 && k < 20; k++) {
+        size_t from = rng() % (len - 200), to = rng() % (len - 200);
+        memmove(buf + to, buf + from, rng() % 200);
+    }
+}
+
+// Decode a copy of src allocated to exactly src_len bytes into a buffer of
+// exactly dst_len bytes
+static int decode_exact(const unsigned char *src, size_t src_len, unsigned char *expect, size_t dst_len) {
+    unsigned char *in = malloc(src_len ? src_len : 1);
+    unsigned char *out = malloc(dst_len ? dst_len : 1);
+    if (!in || !out) {
+        free(in);
+        free(out);
+        return -1;
+    }
+    memcpy(in, src, src_len);
+    int result = lz_decompress(in, src_len, out, dst_len);
+    if (result == 0 && expect && memcmp(out, expect, dst_len) != 0) result = -2;
+    free(in);
+    free(out);
+    return result;
+}
+
+static int test_lz(void) {
+    static unsigned char src[CONTAINER_BLOCK_SIZE], packed[CONTAINER_BLOCK_SIZE];
+    int failures = 0;
+    size_t raw = 0, stored = 0;
+    for (int t = 0; t < LZ_CASES; t++) {
+        size_t len = rng() % (CONTAINER_BLOCK_SIZE + 1);
+        fill_block(src, len, t % 4);
+        // As the container stores it: compressed only when it shrinks
+        size_t n = lz_compress(src, len, packed, len ? len - 1 : 0);
+        if (n == 0) continue;
+        raw += len;
+        stored += n;
+        if (decode_exact(packed, n, src, len) != 0) {
+            printf("FAIL: round trip of %zu bytes (kind %d, case %d)\n", len, t % 4, t);
+            failures++;
+        }
+        packed[rng() % n] ^= 1 << (rng() % 8);
+        decode_exact(packed, n, NULL, len);
+        decode_exact(packed, rng() % n, NULL, len);
+        decode_exact(packed, n, NULL, rng() % (len + 1));
+    }
+    printf("lz: %d cases, %zu bytes compressed to %zu, %d failures\n", LZ_CASES, raw, stored, failures);
+    return failures;
+}
+
+// Keep the dumper's messages about refused files out of the test output
+static int saved_stdout = -1;
+
+static void quiet(int on) {
+    fflush(stdout);
+    if (on) {
+        saved_stdout = dup(STDOUT_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+    } else if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static int write_file(const char *path, const unsigned char *data, size_t len) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    int failed = write_all(fd, data, len) != 0;
+    close(fd);
+    return failed ? -1 : 0;
+}
+
+// Write a container of one region holding every kind of block, from a raw
+// file loaded the way --offline FILE@ADDR loads it
+static int make_container(const char *dir, unsigned char *data, char *path, size_t path_size) {
+    for (size_t b = 0; b < TEST_SIZE; b += CONTAINER_BLOCK_SIZE) {
+        size_t len = TEST_SIZE - b < CONTAINER_BLOCK_SIZE ? TEST_SIZE - b : CONTAINER_BLOCK_SIZE;
+        fill_block(data + b, len, (b / CONTAINER_BLOCK_SIZE) % 4);
+    }
+    char raw_path[PATH_MAX], source[PATH_MAX + 32];
+    snprintf(raw_path, sizeof(raw_path), "%s/raw.bin", dir);
+    snprintf(source, sizeof(source), "%s@%lx", raw_path, TEST_BASE);
+    snprintf(path, path_size, "%s/test.mdc", dir);
+    if (write_file(raw_path, data, TEST_SIZE) != 0) return -1;
+
+    OfflineImage image;
+    RegionTable table;
+    char *sources[] = { source };
+    if (offline_image_load(&image, sources, 1, &table) != 0) {
+        region_table_free(&table);
+        return -1;
+    }
+    MemoryReader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.backend = READ_BACKEND_OFFLINE;
+    reader.mem_fd = -1;
+    reader.image = &image;
+    MemoryRegion *region = &table.items[0];
+    quiet(1);
+    int result = container_write(path, &reader, &region, 1);
+    quiet(0);
+    offline_image_free(&image);
+    region_table_free(&table);
+    unlink(raw_path);
+    return result;
+}
+
+// Load the file as --offline does and read the start of every region
+static void read_offline(const char *path, unsigned char *buf) {
+    OfflineImage image;
+    RegionTable table;
+    char *sources[] = { (char *)path };
+    if (offline_image_load(&image, sources, 1, &table) != 0) {
+        region_table_free(&table);
+        return;
+    }
+    for (int i = 0; i < table.count; i++) {
+        size_t len = table.items[i].end - table.items[i].start;
+        ReadRequest req = { table.items[i].start, buf, len < TEST_SIZE ? len : TEST_SIZE };
+        offline_read_batch(&image, &req, 1);
+    }
+    offline_image_free(&image);
+    region_table_free(&table);
+}
+
+static int test_container(void) {
+    char dir[] = "/tmp/test_container.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[PATH_MAX], bad_path[PATH_MAX];
+    snprintf(bad_path, sizeof(bad_path), "%s/bad.mdc", dir);
+    unsigned char *data = malloc(TEST_SIZE);
+    unsigned char *back = malloc(TEST_SIZE);
+    int failures = 0;
+    if (!data || !back || make_container(dir, data, path, sizeof(path)) != 0) {
+        printf("FAIL: cannot write a container\n");
+        failures++;
+    }
+
+    Container container;
+    if (!failures && container_open(&container, path) == 0) {
+        if (container_read(&container, TEST_BASE, back, TEST_SIZE) != 0 || memcmp(data, back, TEST_SIZE) != 0) {
+            printf("FAIL: container does not read back what was written\n");
+            failures++;
+        }
+        container_close(&container);
+    } else if (!failures) {
+        printf("FAIL: cannot open the container just written\n");
+        failures++;
+    }
+
+    // Overwrite bytes anywhere, but mostly in the header, region table and
+    // block index, where a bad value sends the reader furthest
+    struct stat st;
+    unsigned char *file = NULL;
+    int fd = failures ? -1 : open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && fstat(fd, &st) == 0 && (file = malloc(st.st_size))) {
+        if (pread(fd, file, st.st_size, 0) != st.st_size) {
+            free(file);
+            file = NULL;
+        }
+    }
+    if (fd >= 0) close(fd);
+    if (!failures && !file) {
+        printf("FAIL: cannot read the container back\n");
+        failures++;
+    }
+
+    int opened = 0;
+    size_t size = file ? (size_t)st.st_size : 0;
+    size_t meta = sizeof(ContainerHeader) + sizeof(RegionRecord);
+    size_t index = file ? ((const ContainerHeader *)file)->index_offset : 0;
+    unsigned char *copy = file ? malloc(size) : NULL;
+    for (int t = 0; copy && t < CORRUPT_CASES; t++) {
+        memcpy(copy, file, size);
+        int bytes = 1 + rng() % 4;
+        for (int k = 0; k < bytes; k++) {
+            size_t at;
+            switch (rng() % 3) {
+            case 0: at = rng() % meta; break;
+            case 1: at = index + rng() % (size - index); break;
+            default: at = rng() % size; break;
+            }
+            copy[at] = (rng() % 4) ? rng() : (rng() % 2 ? 0xff : 0);
+        }
+        // Also cut the file short now and then
+        size_t len = (rng() % 8) ? size : rng() % size;
+        if (write_file(bad_path, copy, len) != 0) break;
+
+        quiet(1);
+        if (container_open(&container, bad_path) == 0) {
+            opened++;
+            container_read(&container, TEST_BASE, back, TEST_SIZE);
+            unsigned long addr = TEST_BASE + rng() % TEST_SIZE;
+            container_read(&container, addr, back, rng() % (TEST_BASE + TEST_SIZE - addr + 1));
+            container_close(&container);
+            read_offline(bad_path, back);
+        }
+        quiet(0);
+    }
+    printf("container: %d corrupted copies, %d opened and read, %d failures\n",
+           CORRUPT_CASES, opened, failures);
+
+    free(copy);
+    free(file);
+    free(data);
+    free(back);
+    unlink(path);
+    unlink(bad_path);
+    rmdir(dir);
+    return failures;
+}
+
+int main(void) {
+    int failures = test_lz() + test_container();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+// Differential test of the regex scanner against glibc's POSIX regexec,
+// run by "make test" under AddressSanitizer and UBSan. The dumper is
+// compiled in whole, with its main renamed.
+//
+// Random strings over a small alphabet are fed to a scan stream in chunks
+// of random sizes, so matches straddle chunk boundaries. The reported
+// matches must be exactly the leftmost-longest, non-overlapping matches
+// regexec finds scanning left to right, with the same bytes.
+
+#define main memory_dumper_main
+#include "memory_dumper.c"
+#undef main
+
+#include <regex.h>
+
+#define REGEX_CASES 5000
+#define REGEX_TEXT 3000
+#define REGEX_BASE 0x10000UL
+
+static const char *test_patterns[] = {
+    "a+b", "(ab|a)(c|bcd)", "a{2,3}b?", "[ab]+c", "(a|b)*c", "b(a|ab)*c",
+    "c[^c]{2,4}c", "(a|ab)(c|bcd)?", "a.c", "(?i)A+B", "ab|ba|abc", "[a-b]{3}",
+    "(aa|b)+", "c+", "a(a|b){11}c", "(a|b|c)*a(a|b|c){9}b",
+    // A later, shorter alternative ends before the leftmost match does
+    "abcd|c", "a[a-z]*z|b", "ab(c|d)*e|b", "(a|b)*cc|b", "abc|b", "a(a|b)*c|b",
+};
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Scan text as the dumper would, chunk by chunk
+static int scan_text(const Regex *regex, const char *text, size_t len, MatchList *matches) {
+    static MemoryRegion region;
+    region.pathname = "";
+    RegexMatcher matcher;
+    ScanStream stream;
+    match_list_init(matches);
+    if (regex_matcher_init(&matcher, regex) != 0) return -1;
+    if (scan_stream_init(&stream, &region, NULL, NULL, regex, &matcher, NULL, matches,
+                         REGEX_BASE, REGEX_BASE + len) != 0) {
+        regex_matcher_free(&matcher);
+        return -1;
+    }
+    for (size_t off = 0; off < len; ) {
+        size_t chunk = 1 + rng() % ((rng() % 2) ? 5 : 700);
+        if (chunk > len - off) chunk = len - off;
+        scan_stream_feed((const unsigned char *)text + off, chunk, REGEX_BASE + off, &stream);
+        off += chunk;
+    }
+    scan_stream_finish(&stream);
+    scan_stream_free(&stream);
+    regex_matcher_free(&matcher);
+    return 0;
+}
+
+// Compare with regexec; returns the number of matches, or -1 on a mismatch
+static long check_matches(const char *pattern, regex_t *reference, const char *text, size_t len,
+                            const MatchList *matches) {
+    size_t k = 0;
+    size_t pos = 0;
+    regmatch_t rm;
+    while (pos < len && regexec(reference, text + pos, 1, &rm, pos ? REG_NOTBOL : 0) == 0) {
+        unsigned long addr = REGEX_BASE + pos + rm.rm_so;
+        unsigned match_len = rm.rm_eo - rm.rm_so;
+        const Match *match = k < matches->count ? &matches->items[k] : NULL;
+        if (!match || match->addr != addr || match->match_len != match_len) {
+            printf("FAIL: %s: match %zu expected at %lu (%u bytes), got %ld (%u bytes)\n",
+                   pattern, k, addr - REGEX_BASE, match_len,
+                   match ? (long)(match->addr - REGEX_BASE) : -1L, match ? match->match_len : 0);
+            return -1;
+        }
+        const unsigned char *bytes = matches->bytes + match->context_off + match->context_before;
+        if (memcmp(bytes, text + pos + rm.rm_so, match_len) != 0) {
+            printf("FAIL: %s: match %zu holds the wrong bytes\n", pattern, k);
+            return -1;
+        }
+        k++;
+        pos += rm.rm_eo;
+    }
+    if (k != matches->count) {
+        printf("FAIL: %s: %zu matches expected, got %zu\n", pattern, k, matches->count);
+        return -1;
+    }
+    return k;
+}
+
+int main(void) {
+    size_t pattern_count = sizeof(test_patterns) / sizeof(test_patterns[0]);
+    char text[REGEX_TEXT + 1];
+    long total = 0;
+    int failures = 0;
+    for (int t = 0; t < REGEX_CASES && failures < 10; t++) {
+        const char *pattern = test_patterns[t % pattern_count];
+        int icase = strncmp(pattern, "(?i)", 4) == 0;
+        Regex regex;
+        regex_t reference;
+        if (regex_compile(&regex, pattern) != 0) return 1;
+        if (regcomp(&reference, pattern + (icase ? 4 : 0), REG_EXTENDED | (icase ? REG_ICASE : 0)) != 0) {
+            printf("regcomp refused %s\n", pattern);
+            regex_free(&regex);
+            return 1;
+        }
+
+        // Two or three letters, both cases of two when case is ignored, or
+        // every letter the pattern names past c
+        size_t len = rng() % REGEX_TEXT;
+        const char *alphabet = icase ? "abAB" : strpbrk(pattern, "dez") ? "abcdez" : "abc";
+        int letters = icase ? 4 : strlen(alphabet) > 3 ? 6 : 2 + rng() % 2;
+        for (size_t i = 0; i < len; i++) text[i] = alphabet[rng() % letters];
+        text[len] = '\0';
+
+        MatchList matches;
+        long found = -1;
+        if (scan_text(&regex, text, len, &matches) == 0) {
+            found = check_matches(pattern, &reference, text, len, &matches);
+        } else {
+            printf("FAIL: %s: cannot set up the scan\n", pattern);
+        }
+        if (found < 0) failures++;
+        else total += found;
+        match_list_free(&matches);
+        regfree(&reference);
+        regex_free(&regex);
+    }
+    printf("regex: %d cases, %ld matches compared, %d failures\n", REGEX_CASES, total, failures);
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -6,13 +6,29 @@
 #include <unistd.h>
 #include <sys/ptrace.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <limits.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <signal.h>
 
 #ifdef __APPLE__
 #include <sys/types.h>
 #include <mach/mach.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
 // If PTRACE_PEEKDATA is still not defined, define it manually
 #ifndef PTRACE_PEEKDATA
 #define PTRACE_PEEKDATA 2
@@ -26,63 +42,354 @@
 #define PTRACE_DETACH 17
 #endif
 
-#define PATTERN_SIZE 16
-#define MAX_MEMORY_REGIONS 1000
+#define AUTO_PATTERN_SIZE 16 // Length of the auto-mode test pattern
+
+#define PAGE_SIZE_BYTES 4096 // Snapshot store page and zero-check block; kernel pages may be larger
+#define READ_BATCH_BYTES (1024 * 1024) // Bytes fetched per batched read
+#define READ_BATCH_MAX_CHUNKS 1024
+#define DEFAULT_CHUNK_SIZE (1024 * 1024)
+#define MATCH_CONTEXT_BYTES 8
+#define SCAN_SLICE_SIZE (16 * 1024 * 1024) // Unit of work for the scan pool
+#define DUMP_WINDOW_SIZE (64 * 1024 * 1024) // Output file mapped this much at a time
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static size_t page_size = PAGE_SIZE_BYTES; // Of the running kernel, set at startup
 
 typedef struct {
     unsigned long start;
     unsigned long end;
     char permissions[8];
-    char pathname[256];
+    const char *pathname; // "" for anonymous mappings; owned by the RegionTable
+    int index;            // Position in the table, names dump files
+    unsigned long offset;
+    unsigned int dev_major;
+    unsigned int dev_minor;
+    unsigned long inode;
+    // From /proc/<pid>/smaps when joined, in bytes
+    size_t rss;
+    size_t anonymous;
+    size_t anon_huge;
+    size_t swap;
 } MemoryRegion;
 
-void read_memory_regions(pid_t pid, MemoryRegion *regions, int *count) {
-    char maps_path[256];
-    sprintf(maps_path, "/proc/%d/maps", pid);
+// Storage for pathnames. The maps file itself is one block: its lines are
+// cut in place and the regions point into it.
+typedef struct StringBlock {
+    struct StringBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} StringBlock;
+
+#define STRING_BLOCK_SIZE (64 * 1024)
+
+// Growable list of a process's memory regions, in address order
+typedef struct {
+    MemoryRegion *items;
+    int count;
+    int cap;
+    int has_smaps;
+    StringBlock *strings;
+} RegionTable;
+
+void region_table_init(RegionTable *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+void region_table_free(RegionTable *table) {
+    while (table->strings) {
+        StringBlock *next = table->strings->next;
+        free(table->strings);
+        table->strings = next;
+    }
+    free(table->items);
+    memset(table, 0, sizeof(*table));
+}
+
+// Append a zeroed region; NULL when out of memory
+MemoryRegion *region_table_add(RegionTable *table) {
+    if (table->count == table->cap) {
+        int new_cap = table->cap ? table->cap * 2 : 256;
+        MemoryRegion *items = realloc(table->items, new_cap * sizeof(*items));
+        if (!items) return NULL;
+        table->items = items;
+        table->cap = new_cap;
+    }
+    MemoryRegion *region = &table->items[table->count];
+    memset(region, 0, sizeof(*region));
+    region->pathname = "";
+    region->index = table->count++;
+    return region;
+}
+
+// Copy a string into the table's storage
+const char *region_table_strdup(RegionTable *table, const char *s) {
+    size_t len = strlen(s) + 1;
+    StringBlock *block = table->strings;
+    if (!block || block->size - block->used < len) {
+        size_t size = len > STRING_BLOCK_SIZE ? len : STRING_BLOCK_SIZE;
+        block = malloc(sizeof(*block) + size);
+        if (!block) return NULL;
+        block->next = table->strings;
+        block->used = 0;
+        block->size = size;
+        table->strings = block;
+    }
+    char *copy = block->data + block->used;
+    memcpy(copy, s, len);
+    block->used += len;
+    return copy;
+}
+
+// Read a whole /proc file with as few read() calls as it allows. The
+// result is a StringBlock (already linked into table) with a NUL after
+// the data.
+static StringBlock *read_proc_file(RegionTable *table, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    size_t size = STRING_BLOCK_SIZE;
+    StringBlock *block = malloc(sizeof(*block) + size);
+    if (block) block->used = 0;
+    while (block) {
+        if (block->used + 1 == size) {
+            StringBlock *grown = realloc(block, sizeof(*block) + size * 2);
+            if (!grown) {
+                free(block);
+                block = NULL;
+                break;
+            }
+            block = grown;
+            size *= 2;
+        }
+        ssize_t n = read(fd, block->data + block->used, size - 1 - block->used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror(path);
+            free(block);
+            block = NULL;
+            break;
+        }
+        if (n == 0) break;
+        block->used += n;
+    }
+    close(fd);
+    if (!block) return NULL;
     
-    FILE *maps_file = fopen(maps_path, "r");
-    if (!maps_file) {
-        perror("fopen maps");
-        return;
+    block->data[block->used] = '\0';
+    block->size = block->used + 1;
+    block->used = block->size; // No room for region_table_strdup
+    block->next = table->strings;
+    table->strings = block;
+    return block;
+}
+
+static unsigned long parse_hex(const char **p) {
+    unsigned long value = 0;
+    for (;; (*p)++) {
+        char c = **p;
+        if (c >= '0' && c <= '9') value = (value << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f') value = (value << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value = (value << 4) | (c - 'A' + 10);
+        else return value;
     }
+}
+
+static unsigned long parse_dec(const char **p) {
+    unsigned long value = 0;
+    for (; **p >= '0' && **p <= '9'; (*p)++) value = value * 10 + (**p - '0');
+    return value;
+}
+
+// Parse /proc/<pid>/maps into table. The file is read in one go and
+// parsed in place: each line is
+//   start-end perms offset major:minor inode   pathname
+// and the pathname (which may contain spaces) is cut out of the buffer
+// rather than copied.
+int read_memory_regions(pid_t pid, RegionTable *table) {
+    char maps_path[64];
+    snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", pid);
     
-    *count = 0;
-    char line[512];
-    while (fgets(line, sizeof(line), maps_file)) {
-        if (*count >= MAX_MEMORY_REGIONS) break;
+    region_table_init(table);
+    StringBlock *block = read_proc_file(table, maps_path);
+    if (!block) return -1;
+    
+    char *line = block->data;
+    char *end = block->data + block->size - 1;
+    while (line < end) {
+        char *eol = memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        *eol = '\0';
         
-        // Parse the memory map line
-        char perms[8];
-        unsigned long start, end;
-        char pathname[256] = "";
+        const char *p = line;
+        MemoryRegion *region = region_table_add(table);
+        if (!region) {
+            printf("Out of memory reading %s\n", maps_path);
+            region_table_free(table);
+            return -1;
+        }
+        region->start = parse_hex(&p);
+        if (*p == '-') p++;
+        region->end = parse_hex(&p);
+        while (*p == ' ') p++;
+        size_t perms_len = 0;
+        while (*p && *p != ' ') {
+            if (perms_len < sizeof(region->permissions) - 1) region->permissions[perms_len++] = *p;
+            p++;
+        }
+        while (*p == ' ') p++;
+        region->offset = parse_hex(&p);
+        while (*p == ' ') p++;
+        region->dev_major = parse_hex(&p);
+        if (*p == ':') p++;
+        region->dev_minor = parse_hex(&p);
+        while (*p == ' ') p++;
+        region->inode = parse_dec(&p);
+        while (*p == ' ') p++;
+        region->pathname = p;
         
-        int parsed = sscanf(line, "%lx-%lx %7s %*s %*s %*s %255s",
-                           &start, &end, perms, pathname);
+        if (region->end <= region->start) table->count--; // Malformed line
+        line = eol + 1;
+    }
+    return 0;
+}
+
+// Fill in the Rss, Anonymous, AnonHugePages and Swap fields from
+// /proc/<pid>/smaps. smaps is much larger than maps, so it is streamed
+// through a fixed buffer and matched to the table by start address.
+int region_table_join_smaps(pid_t pid, RegionTable *table) {
+    char smaps_path[64];
+    snprintf(smaps_path, sizeof(smaps_path), "/proc/%d/smaps", pid);
+    int fd = open(smaps_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(smaps_path);
+        return -1;
+    }
+    
+    size_t size = STRING_BLOCK_SIZE;
+    char *buf = malloc(size + 1);
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    size_t have = 0;
+    int cursor = 0;
+    MemoryRegion *current = NULL;
+    for (;;) {
+        ssize_t n = read(fd, buf + have, size - have);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror(smaps_path);
+            break;
+        }
+        have += n;
+        buf[have] = '\0';
         
-        if (parsed >= 3) {
-            regions[*count].start = start;
-            regions[*count].end = end;
-            strncpy(regions[*count].permissions, perms, sizeof(regions[*count].permissions) - 1);
-            regions[*count].permissions[sizeof(regions[*count].permissions) - 1] = '\0';
-            
-            if (parsed >= 4) {
-                strncpy(regions[*count].pathname, pathname, sizeof(regions[*count].pathname) - 1);
-                regions[*count].pathname[sizeof(regions[*count].pathname) - 1] = '\0';
-            } else {
-                regions[*count].pathname[0] = '\0';
+        char *line = buf;
+        char *eol;
+        while ((eol = memchr(line, '\n', buf + have - line)) != NULL || (n == 0 && line < buf + have)) {
+            if (eol) *eol = '\0';
+            const char *p = line;
+            if ((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f')) {
+                // Header line of the next mapping
+                unsigned long start = parse_hex(&p);
+                while (cursor < table->count && table->items[cursor].start < start) cursor++;
+                current = (cursor < table->count && table->items[cursor].start == start) ?
+                          &table->items[cursor] : NULL;
+            } else if (current) {
+                size_t *field = NULL;
+                if (strncmp(p, "Rss:", 4) == 0) field = &current->rss;
+                else if (strncmp(p, "Anonymous:", 10) == 0) field = &current->anonymous;
+                else if (strncmp(p, "AnonHugePages:", 14) == 0) field = &current->anon_huge;
+                else if (strncmp(p, "Swap:", 5) == 0) field = &current->swap;
+                if (field) {
+                    p = strchr(p, ':') + 1;
+                    while (*p == ' ') p++;
+                    *field = parse_dec(&p) * 1024; // Reported in kB
+                }
+            }
+            if (!eol) {
+                line = buf + have;
+                break;
             }
-            (*count)++;
+            line = eol + 1;
         }
+        
+        // Keep the partial last line for the next read
+        have -= line - buf;
+        memmove(buf, line, have);
+        if (n == 0) break;
+        if (have == size) have = 0; // A line longer than the buffer: drop it
     }
-    
-    fclose(maps_file);
+    free(buf);
+    close(fd);
+    table->has_smaps = 1;
+    return 0;
 }
 
-unsigned char *read_process_memory(pid_t pid, unsigned long addr, size_t length) {
-    unsigned char *buffer = malloc(length);
-    if (!buffer) return NULL;
+typedef enum {
+    READ_BACKEND_AUTO,     // Probe at attach time
+    READ_BACKEND_VM_READV, // process_vm_readv, many iovecs per syscall
+    READ_BACKEND_PROC_MEM, // preadv on /proc/<pid>/mem
+    READ_BACKEND_PTRACE,   // PTRACE_PEEKDATA, one word per syscall (fallback)
+    READ_BACKEND_OFFLINE   // Dump files mapped from disk, no live process
+} ReadBackend;
+
+struct OfflineImage;
+
+typedef struct {
+    pid_t pid;
+    ReadBackend backend;
+    int mem_fd; // Open /proc/<pid>/mem for READ_BACKEND_PROC_MEM, else -1
+    const struct OfflineImage *image; // For READ_BACKEND_OFFLINE
+    int shared;  // Read from several threads: the backend must not change
+    int refused; // errno of a refusal seen while shared, else 0
+} MemoryReader;
+
+// One remote range to copy into a local buffer
+typedef struct {
+    unsigned long addr;
+    unsigned char *buf;
+    size_t len;
+} ReadRequest;
+
+const char *read_backend_name(ReadBackend backend) {
+    switch (backend) {
+    case READ_BACKEND_AUTO:     return "auto";
+    case READ_BACKEND_VM_READV: return "vm";
+    case READ_BACKEND_PROC_MEM: return "mem";
+    case READ_BACKEND_PTRACE:   return "ptrace";
+    case READ_BACKEND_OFFLINE:  return "offline";
+    }
+    return "unknown";
+}
+
+int parse_read_backend(const char *name, ReadBackend *backend) {
+    for (ReadBackend b = READ_BACKEND_AUTO; b <= READ_BACKEND_PTRACE; b++) {
+        if (strcmp(name, read_backend_name(b)) == 0) {
+            *backend = b;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Page-aligned buffer for bulk reads; release with free()
+unsigned char *alloc_read_buffer(size_t size) {
+    void *buf = NULL;
+    if (posix_memalign(&buf, page_size, size) != 0) return NULL;
+    return buf;
+}
+
+// Word-at-a-time fallback. Unreadable words are zero-filled.
+static size_t read_range_ptrace(pid_t pid, unsigned long addr, unsigned char *buf, size_t length) {
+    size_t bytes_read = 0;
     
-    // Read memory word by word using ptrace
     for (size_t i = 0; i < length; i += sizeof(long)) {
         errno = 0;
         #ifdef __APPLE__
@@ -93,237 +400,7396 @@ unsigned char *read_process_memory(pid_t pid, unsigned long addr, size_t length)
         long word = ptrace(PTRACE_PEEKDATA, pid, addr + i, NULL);
         #endif
         
+        size_t bytes_to_copy = (length - i < sizeof(long)) ? length - i : sizeof(long);
         if (errno != 0) {
             // If we can't read, fill with zeros and continue
             word = 0;
+        } else {
+            bytes_read += bytes_to_copy;
         }
-        
-        size_t bytes_to_copy = (length - i < sizeof(long)) ? length - i : sizeof(long);
-        memcpy(buffer + i, &word, bytes_to_copy);
+        memcpy(buf + i, &word, bytes_to_copy);
     }
     
-    return buffer;
+    return bytes_read;
 }
 
-int search_pattern_in_region(pid_t pid, MemoryRegion *region, 
-                           unsigned char *pattern, size_t pattern_size) {
-    // Skip non-readable regions and very large regions
-    if (!(region->permissions[0] == 'r') || (region->end - region->start) > 100 * 1024 * 1024) {
-        return 0;
+#ifndef __APPLE__
+// Copy local[]/remote[] with a single syscall of the reader's backend.
+// /proc/<pid>/mem callers must pass one contiguous remote range.
+static ssize_t read_iov(MemoryReader *reader, struct iovec *local,
+                        struct iovec *remote, size_t n) {
+    if (reader->backend == READ_BACKEND_PROC_MEM) {
+        return preadv(reader->mem_fd, local, n, (off_t)(unsigned long)remote[0].iov_base);
     }
+    return process_vm_readv(reader->pid, local, n, remote, n, 0);
+}
+
+// Issue as few syscalls as possible for the whole batch: up to IOV_MAX
+// requests per call (contiguous runs only for /proc/<pid>/mem). A short
+// transfer stops at the first unreadable page; that page is zero-filled
+// and the batch resumes after it. Returns -1 only when the backend itself
+// is refused (EPERM, EACCES, ENOSYS), so the caller can fall back.
+static ssize_t read_batch_syscall(MemoryReader *reader, ReadRequest *reqs, size_t count) {
+    struct iovec local[IOV_MAX];
+    struct iovec remote[IOV_MAX];
+    int contiguous_only = (reader->backend == READ_BACKEND_PROC_MEM);
+    size_t total = 0;
+    size_t req = 0;      // First request not yet fully handled
+    size_t req_off = 0;  // Bytes of reqs[req] already handled
     
-    size_t region_size = region->end - region->start;
-    size_t chunk_size = 4096; // Read in 4KB chunks
-    int found = 0;
-    
-    printf("Searching region: %lx-%lx %s %s\n", 
-           region->start, region->end, region->permissions, 
-           region->pathname[0] ? region->pathname : "[anonymous]");
-    
-    for (unsigned long offset = 0; offset < region_size; offset += chunk_size) {
-        size_t read_size = (offset + chunk_size <= region_size) ? chunk_size : region_size - offset;
-        
-        // Don't read too much at once
-        if (read_size > 64 * 1024) {
-            read_size = 64 * 1024;
-        }
-        
-        unsigned char *chunk = read_process_memory(pid, region->start + offset, read_size);
-        
-        if (!chunk) continue;
-        
-        // Search for pattern in this chunk
-        for (size_t i = 0; i <= read_size - pattern_size; i++) {
-            if (memcmp(chunk + i, pattern, pattern_size) == 0) {
-                printf("*** FOUND PATTERN at address: 0x%lx\n", region->start + offset + i);
-                printf("    Memory region: %s\n", region->pathname[0] ? region->pathname : "[anonymous]");
-                
-                // Print surrounding memory for context
-                printf("    Surrounding memory (hex): ");
-                size_t context_start = (i >= 8) ? i - 8 : 0;
-                size_t context_end = (i + pattern_size + 8 <= read_size) ? i + pattern_size + 8 : read_size;
-                
-                for (size_t j = context_start; j < context_end; j++) {
-                    if (j >= i && j < i + pattern_size) {
-                        printf("[%02x]", chunk[j]); // Highlight the pattern
-                    } else {
-                        printf(" %02x ", chunk[j]);
-                    }
-                }
-                printf("\n");
-                found++;
+    while (req < count) {
+        size_t n = 0;
+        size_t requested = 0;
+        for (size_t r = req; r < count && n < IOV_MAX; r++) {
+            size_t off = (r == req) ? req_off : 0;
+            if (reqs[r].len == off) continue;
+            unsigned long addr = reqs[r].addr + off;
+            if (contiguous_only && n > 0 &&
+                addr != (unsigned long)remote[n - 1].iov_base + remote[n - 1].iov_len) {
+                break;
+            }
+            local[n].iov_base = reqs[r].buf + off;
+            local[n].iov_len = reqs[r].len - off;
+            remote[n].iov_base = (void *)addr;
+            remote[n].iov_len = reqs[r].len - off;
+            requested += reqs[r].len - off;
+            n++;
+        }
+        if (n == 0) break;
+        
+        ssize_t got = read_iov(reader, local, remote, n);
+        if (got < 0) {
+            if (errno == EPERM || errno == EACCES || errno == ENOSYS) return -1;
+            got = 0; // EFAULT/EIO/ESRCH: first page unreadable, handled below
+        }
+        total += got;
+        
+        // Advance past the bytes that were copied
+        size_t left = got;
+        while (req < count && (left > 0 || reqs[req].len == req_off)) {
+            size_t remaining = reqs[req].len - req_off;
+            if (left >= remaining) {
+                left -= remaining;
+                req++;
+                req_off = 0;
+            } else {
+                req_off += left;
+                left = 0;
             }
         }
+        if (req >= count || (size_t)got == requested) continue;
         
-        free(chunk);
+        // Zero-fill up to the next page boundary of the faulting address
+        unsigned long fault = reqs[req].addr + req_off;
+        size_t skip = page_size - (fault % page_size);
+        if (skip > reqs[req].len - req_off) skip = reqs[req].len - req_off;
+        memset(reqs[req].buf + req_off, 0, skip);
+        req_off += skip;
     }
     
-    return found;
+    return total;
 }
 
-void dump_memory_region(pid_t pid, MemoryRegion *region, const char *filename) {
-    if (!(region->permissions[0] == 'r')) {
-        printf("Region not readable, skipping dump\n");
-        return;
-    }
+// Check that a backend can read one word at addr. On failure *err is the
+// error, or 0 when the read came back short.
+static int probe_read_backend(MemoryReader *reader, ReadBackend backend, unsigned long addr, int *err) {
+    unsigned char word[sizeof(long)];
+    struct iovec local = { word, sizeof(word) };
+    struct iovec remote = { (void *)addr, sizeof(word) };
     
-    size_t region_size = region->end - region->start;
+    if (backend == READ_BACKEND_PROC_MEM && reader->mem_fd < 0) {
+        char mem_path[64];
+        snprintf(mem_path, sizeof(mem_path), "/proc/%d/mem", reader->pid);
+        reader->mem_fd = open(mem_path, O_RDONLY | O_CLOEXEC);
+        if (reader->mem_fd < 0) {
+            *err = errno;
+            return -1;
+        }
+    }
     
-    // Don't dump very large regions
-    if (region_size > 10 * 1024 * 1024) {
-        printf("Region too large (%zu bytes), skipping dump\n", region_size);
-        return;
+    ReadBackend saved = reader->backend;
+    reader->backend = backend;
+    ssize_t got = read_iov(reader, &local, &remote, 1);
+    *err = got < 0 ? errno : 0;
+    reader->backend = saved;
+    return got == (ssize_t)sizeof(word) ? 0 : -1;
+}
+#endif
+
+void memory_reader_close(MemoryReader *reader) {
+    if (reader->mem_fd >= 0) {
+        close(reader->mem_fd);
+        reader->mem_fd = -1;
     }
+}
+
+// Pick the read backend. AUTO tries process_vm_readv, then /proc/<pid>/mem,
+// then ptrace, probing each against the first readable region. An explicit
+// choice that fails its probe falls back to ptrace.
+void memory_reader_open(MemoryReader *reader, pid_t pid, ReadBackend requested,
+                        MemoryRegion *regions, int region_count) {
+    reader->pid = pid;
+    reader->backend = READ_BACKEND_PTRACE;
+    reader->mem_fd = -1;
+    reader->image = NULL;
+    reader->shared = 0;
+    reader->refused = 0;
     
-    printf("Dumping region %lx-%lx to %s (%zu bytes)\n", 
-           region->start, region->end, filename, region_size);
+    #ifndef __APPLE__
+    unsigned long probe_addr = 0;
+    for (int i = 0; i < region_count; i++) {
+        if (regions[i].permissions[0] == 'r') {
+            probe_addr = regions[i].start;
+            break;
+        }
+    }
+    if (probe_addr == 0) return;
     
-    FILE *dump_file = fopen(filename, "wb");
-    if (!dump_file) {
-        perror("fopen dump file");
-        return;
+    ReadBackend order[] = { READ_BACKEND_VM_READV, READ_BACKEND_PROC_MEM };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        if (requested != READ_BACKEND_AUTO && requested != order[i]) continue;
+        int err;
+        if (probe_read_backend(reader, order[i], probe_addr, &err) == 0) {
+            reader->backend = order[i];
+            break;
+        }
+        printf("Read backend %s unavailable: %s\n",
+               read_backend_name(order[i]), err ? strerror(err) : "short read");
     }
+    if (reader->backend != READ_BACKEND_PROC_MEM) memory_reader_close(reader);
+    #else
+    (void)requested;
+    (void)regions;
+    (void)region_count;
+    #endif
+}
+
+static void memory_reader_fall_back(MemoryReader *reader, int err) {
+    printf("Read backend %s failed (%s), falling back to ptrace reads\n",
+           read_backend_name(reader->backend), strerror(err));
+    memory_reader_close(reader);
+    reader->backend = READ_BACKEND_PTRACE;
+}
+
+// End reading from several threads. If one of them had the backend
+// refused, fall back to ptrace here, on the attaching thread, and return
+// -1: whatever the threads read must be read again from this thread.
+int memory_reader_unshare(MemoryReader *reader) {
+    reader->shared = 0;
+    if (!reader->refused) return 0;
+    memory_reader_fall_back(reader, reader->refused);
+    reader->refused = 0;
+    return -1;
+}
+
+size_t offline_read_batch(const struct OfflineImage *image, ReadRequest *reqs, size_t count);
+const unsigned char *offline_map(const struct OfflineImage *image, unsigned long start, unsigned long end);
+
+// Read every request in one go through the reader's backend. Bytes that
+// cannot be read are zero-filled. Returns the number of bytes actually read.
+size_t read_process_memory_batch(MemoryReader *reader, ReadRequest *reqs, size_t count) {
+    if (reader->backend == READ_BACKEND_OFFLINE) return offline_read_batch(reader->image, reqs, count);
     
-    size_t chunk_size = 4096;
-    for (unsigned long offset = 0; offset < region_size; offset += chunk_size) {
-        size_t read_size = (offset + chunk_size <= region_size) ? chunk_size : region_size - offset;
-        unsigned char *chunk = read_process_memory(pid, region->start + offset, read_size);
+    #ifndef __APPLE__
+    if (reader->backend == READ_BACKEND_VM_READV || reader->backend == READ_BACKEND_PROC_MEM) {
+        ssize_t got = read_batch_syscall(reader, reqs, count);
+        if (got >= 0) return got;
         
-        if (chunk) {
-            fwrite(chunk, 1, read_size, dump_file);
-            free(chunk);
+        if (reader->shared) {
+            // Closing mem_fd under the other threads, or reading with
+            // ptrace off the attaching thread, would lose bytes: leave the
+            // switch to memory_reader_unshare
+            __atomic_store_n(&reader->refused, errno, __ATOMIC_RELAXED);
+            for (size_t i = 0; i < count; i++) memset(reqs[i].buf, 0, reqs[i].len);
+            return 0;
         }
+        memory_reader_fall_back(reader, errno);
     }
+    #endif
     
-    fclose(dump_file);
-    printf("Dump completed: %s\n", filename);
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += read_range_ptrace(reader->pid, reqs[i].addr, reqs[i].buf, reqs[i].len);
+    }
+    return total;
 }
 
-int main(int argc, char *argv[]) {
-    #ifdef __APPLE__
-    printf("WARNING: Running on macOS\n");
-    printf("Note: macOS has strict security restrictions on ptrace:\n");
-    printf("  - You may need to disable System Integrity Protection (SIP)\n");
-    printf("  - You may need to run with sudo\n");
-    printf("  - Code signing requirements may prevent attachment\n");
-    printf("  - /proc filesystem is not available on macOS\n");
-    printf("\nThis tool is designed for Linux. On macOS, use lldb or dtrace instead.\n\n");
-    #endif
+size_t read_process_memory_into(MemoryReader *reader, unsigned long addr,
+                                unsigned char *buf, size_t length) {
+    ReadRequest req = { addr, buf, length };
+    return read_process_memory_batch(reader, &req, 1);
+}
+
+unsigned char *read_process_memory(MemoryReader *reader, unsigned long addr, size_t length) {
+    unsigned char *buffer = malloc(length);
+    if (!buffer) return NULL;
     
-    if (argc < 2) {
-        printf("Usage: %s <target_pid>\n", argv[0]);
-        printf("Or use: %s --launch-target\n", argv[0]);
-        return 1;
-    }
+    read_process_memory_into(reader, addr, buffer, length);
+    return buffer;
+}
+
+// Called once per chunk with a contiguous slice of the region
+typedef void (*ChunkHandler)(const unsigned char *data, size_t len,
+                             unsigned long addr, void *ctx);
+
+// Reusable buffer for chunked reads; each scan worker owns one
+typedef struct {
+    unsigned char *data;
+    ReadRequest *reqs;
+    size_t chunk_size;
+    size_t chunks_per_batch;
+} ReadBuffer;
+
+void read_buffer_free(ReadBuffer *buf) {
+    free(buf->data);
+    free(buf->reqs);
+    buf->data = NULL;
+    buf->reqs = NULL;
+}
+
+int read_buffer_init(ReadBuffer *buf, size_t chunk_size) {
+    buf->chunk_size = chunk_size;
+    buf->chunks_per_batch = READ_BATCH_BYTES / chunk_size;
+    if (buf->chunks_per_batch < 1) buf->chunks_per_batch = 1;
+    if (buf->chunks_per_batch > READ_BATCH_MAX_CHUNKS) buf->chunks_per_batch = READ_BATCH_MAX_CHUNKS;
     
-    pid_t target_pid;
+    buf->data = alloc_read_buffer(chunk_size * buf->chunks_per_batch);
+    buf->reqs = malloc(buf->chunks_per_batch * sizeof(ReadRequest));
+    if (!buf->data || !buf->reqs) {
+        read_buffer_free(buf);
+        return -1;
+    }
+    return 0;
+}
+
+// Read [start, end) front to back and hand each chunk to the handler in
+// address order. Small chunks are fetched several per read call, up to
+// READ_BATCH_BYTES.
+void read_range_chunks(MemoryReader *reader, ReadBuffer *buf, unsigned long start,
+                       unsigned long end, ChunkHandler handler, void *ctx) {
+    size_t batch_size = buf->chunk_size * buf->chunks_per_batch;
     
-    if (strcmp(argv[1], "--launch-target") == 0) {
-        // Launch the target program
-        printf("Launching target program...\n");
-        pid_t child_pid = fork();
-        
-        if (child_pid == 0) {
-            // Child process - execute target program
-            char *args[] = {"./target_program", NULL};
-            execv(args[0], args);
-            perror("execv");
-            exit(1);
-        } else {
-            target_pid = child_pid;
-            sleep(2); // Give target time to initialize and print its bytes
+    // A raw dump file is already in memory: hand out the mapping itself
+    const unsigned char *mapped = NULL;
+    if (reader->backend == READ_BACKEND_OFFLINE) mapped = offline_map(reader->image, start, end);
+    if (mapped) {
+        for (unsigned long addr = start; addr < end; addr += buf->chunk_size) {
+            size_t len = (addr + buf->chunk_size <= end) ? buf->chunk_size : end - addr;
+            handler(mapped + (addr - start), len, addr, ctx);
         }
-    } else {
-        target_pid = atoi(argv[1]);
+        return;
     }
     
-    printf("Attaching to PID: %d\n", target_pid);
-    
-    // Attach to target process
-    #ifdef __APPLE__
-    if (ptrace(PT_ATTACH, target_pid, 0, 0) == -1) {
-    #else
-    if (ptrace(PTRACE_ATTACH, target_pid, NULL, NULL) == -1) {
-    #endif
-        perror("ptrace attach");
-        printf("\nIf on macOS, try:\n");
-        printf("  1. Run with sudo: sudo %s %d\n", argv[0], target_pid);
-        printf("  2. Disable SIP (not recommended for security)\n");
-        printf("  3. Use a Linux VM or container\n");
-        return 1;
+    for (unsigned long batch_addr = start; batch_addr < end; batch_addr += batch_size) {
+        size_t nreqs = 0;
+        for (unsigned long addr = batch_addr;
+             addr < end && nreqs < buf->chunks_per_batch; addr += buf->chunk_size) {
+            buf->reqs[nreqs].addr = addr;
+            buf->reqs[nreqs].buf = buf->data + (addr - batch_addr);
+            buf->reqs[nreqs].len = (addr + buf->chunk_size <= end) ? buf->chunk_size : end - addr;
+            nreqs++;
+        }
+        read_process_memory_batch(reader, buf->reqs, nreqs);
+        for (size_t c = 0; c < nreqs; c++) {
+            handler(buf->reqs[c].buf, buf->reqs[c].len, buf->reqs[c].addr, ctx);
+        }
     }
+}
+
+// ---- Match lists ----
+//
+// Matches are collected rather than printed as they are found, so scan
+// workers can run in parallel and the merged output can be sorted.
+
+typedef struct {
+    unsigned long addr;
+    MemoryRegion *region;
+    int pattern;             // Index in the pattern set, or -1 for a single pattern
+    unsigned match_len;
+    unsigned context_before; // Context bytes stored ahead of the match
+    unsigned context_len;    // Bytes stored, match included
+    size_t context_off;      // Offset into MatchList.bytes
+} Match;
+
+typedef struct {
+    Match *items;
+    size_t count;
+    size_t cap;
+    unsigned char *bytes;    // Match bytes plus surrounding context
+    size_t bytes_len;
+    size_t bytes_cap;
+} MatchList;
+
+void match_list_init(MatchList *list) {
+    memset(list, 0, sizeof(*list));
+}
+
+void match_list_free(MatchList *list) {
+    free(list->items);
+    free(list->bytes);
+    match_list_init(list);
+}
+
+static int match_list_reserve(MatchList *list, size_t items, size_t bytes) {
+    if (list->count + items > list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        while (cap < list->count + items) cap *= 2;
+        Match *grown = realloc(list->items, cap * sizeof(Match));
+        if (!grown) return -1;
+        list->items = grown;
+        list->cap = cap;
+    }
+    if (list->bytes_len + bytes > list->bytes_cap) {
+        size_t cap = list->bytes_cap ? list->bytes_cap * 2 : 4096;
+        while (cap < list->bytes_len + bytes) cap *= 2;
+        unsigned char *grown = realloc(list->bytes, cap);
+        if (!grown) return -1;
+        list->bytes = grown;
+        list->bytes_cap = cap;
+    }
+    return 0;
+}
+
+// Record the match at data + pos together with up to MATCH_CONTEXT_BYTES
+// of context on each side
+int match_list_add(MatchList *list, MemoryRegion *region, const unsigned char *data,
+                   size_t len, unsigned long data_addr, long pos, size_t match_len, int pattern) {
+    long context_start = (pos >= MATCH_CONTEXT_BYTES) ? pos - MATCH_CONTEXT_BYTES : 0;
+    long context_end = pos + (long)match_len + MATCH_CONTEXT_BYTES;
+    if (context_end > (long)len) context_end = (long)len;
+    size_t context_len = context_end - context_start;
     
-    // Wait for the target to stop
-    int status;
-    waitpid(target_pid, &status, 0);
-    printf("Successfully attached to target process\n");
-    
-    // Read memory regions
-    MemoryRegion regions[MAX_MEMORY_REGIONS];
-    int region_count;
-    read_memory_regions(target_pid, regions, &region_count);
-    
-    printf("Found %d memory regions\n", region_count);
+    if (match_list_reserve(list, 1, context_len) != 0) return -1;
     
-    // Ask user for pattern or use auto-mode
-    unsigned char pattern[PATTERN_SIZE];
-    char choice;
-    printf("Do you want to manually enter the 16-byte pattern? (y/n): ");
-    scanf(" %c", &choice);
+    Match *match = &list->items[list->count++];
+    match->addr = data_addr + pos;
+    match->region = region;
+    match->pattern = pattern;
+    match->match_len = match_len;
+    match->context_before = pos - context_start;
+    match->context_len = context_len;
+    match->context_off = list->bytes_len;
+    memcpy(list->bytes + list->bytes_len, data + context_start, context_len);
+    list->bytes_len += context_len;
+    return 0;
+}
+
+// Move every match of src to the end of dst
+int match_list_append(MatchList *dst, const MatchList *src) {
+    if (src->count == 0) return 0;
+    if (match_list_reserve(dst, src->count, src->bytes_len) != 0) return -1;
     
-    if (choice == 'y' || choice == 'Y') {
-        printf("Enter 16 bytes to search for (hex format, space separated): ");
-        for (int i = 0; i < PATTERN_SIZE; i++) {
-            unsigned int byte;
-            if (scanf("%02x", &byte) != 1) {
-                printf("Error reading byte %d\n", i);
-                byte = 0;
-            }
-            pattern[i] = (unsigned char)byte;
-        }
-    } else {
-        // Auto-mode: use a test pattern
-        printf("Auto-mode: using test pattern A-Z\n");
-        for (int i = 0; i < PATTERN_SIZE; i++) {
-            pattern[i] = 0x41 + (i % 26); // A-Z pattern
-        }
+    for (size_t i = 0; i < src->count; i++) {
+        Match *match = &dst->items[dst->count++];
+        *match = src->items[i];
+        match->context_off += dst->bytes_len;
+    }
+    memcpy(dst->bytes + dst->bytes_len, src->bytes, src->bytes_len);
+    dst->bytes_len += src->bytes_len;
+    return 0;
+}
+
+static int compare_matches(const void *a, const void *b) {
+    const Match *x = a, *y = b;
+    if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+    return x->pattern - y->pattern;
+}
+
+// Order by address, then by pattern, so output does not depend on threading
+void match_list_sort(MatchList *list) {
+    if (list->count == 0) return;
+    qsort(list->items, list->count, sizeof(Match), compare_matches);
+}
+
+// Print a match and the bytes around it
+void print_match(const MatchList *list, const Match *match, const char *label) {
+    printf("*** FOUND PATTERN at address: 0x%lx\n", match->addr);
+    if (label) {
+        printf("    Pattern: %s\n", label);
     }
+    printf("    Memory region: %s\n",
+           match->region->pathname[0] ? match->region->pathname : "[anonymous]");
     
-    printf("Searching for pattern: ");
-    for (int i = 0; i < PATTERN_SIZE; i++) {
-        printf("%02x ", pattern[i]);
+    // Print surrounding memory for context
+    printf("    Surrounding memory (hex): ");
+    const unsigned char *bytes = list->bytes + match->context_off;
+    for (unsigned j = 0; j < match->context_len; j++) {
+        if (j >= match->context_before && j < match->context_before + match->match_len) {
+            printf("[%02x]", bytes[j]); // Highlight the pattern
+        } else {
+            printf(" %02x ", bytes[j]);
+        }
     }
     printf("\n");
+}
+
+// ---- Single-pattern scan kernels ----
+//
+// A position is a candidate only when both the first and the last pattern
+// byte match; candidates are then verified. The widest kernel the CPU
+// supports is selected once at startup. Each kernel is also built for
+// 4, 8, 16 and 32-byte patterns (integers, pointers, AES keys, UUIDs):
+// with the length a constant, a candidate is checked with one or two wide
+// loads instead of a memcmp call. Other lengths use the generic build.
+
+typedef const unsigned char *(*FindPatternFn)(const unsigned char *hay, size_t len,
+                                              const unsigned char *pat, size_t pat_len);
+
+typedef struct {
+    const char *name;
+    FindPatternFn find;       // Any length
+    FindPatternFn find_fixed[4]; // 4, 8, 16 and 32 bytes
+} ScanKernel;
+
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+KERNEL_INLINE uint64_t load64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+KERNEL_INLINE uint32_t load32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Whether p holds the pattern; the specialized lengths fold to wide loads
+KERNEL_INLINE int pattern_equal(const unsigned char *p, const unsigned char *pat, size_t pat_len) {
+    switch (pat_len) {
+    case 4:
+        return load32(p) == load32(pat);
+    case 8:
+        return load64(p) == load64(pat);
+    case 16:
+        return ((load64(p) ^ load64(pat)) | (load64(p + 8) ^ load64(pat + 8))) == 0;
+    case 32:
+        return ((load64(p) ^ load64(pat)) | (load64(p + 8) ^ load64(pat + 8)) |
+                (load64(p + 16) ^ load64(pat + 16)) | (load64(p + 24) ^ load64(pat + 24))) == 0;
+    default:
+        return memcmp(p + 1, pat + 1, pat_len - 2) == 0; // Ends already matched
+    }
+}
+
+// Portable kernel: glibc's memchr is already vectorized
+KERNEL_INLINE const unsigned char *find_pattern_scalar_impl(const unsigned char *hay, size_t len,
+                                                            const unsigned char *pat, size_t pat_len) {
+    if (pat_len == 0 || len < pat_len) return NULL;
     
-    // Search for pattern in all memory regions
-    int total_found = 0;
-    for (int i = 0; i < region_count; i++) {
-        total_found += search_pattern_in_region(target_pid, &regions[i], pattern, PATTERN_SIZE);
+    const unsigned char *end = hay + len - pat_len + 1; // One past the last start
+    for (const unsigned char *p = hay; p < end; p++) {
+        p = memchr(p, pat[0], end - p);
+        if (!p) return NULL;
+        if (pat_len == 1) return p;
+        if (p[pat_len - 1] == pat[pat_len - 1] && pattern_equal(p, pat, pat_len)) return p;
+    }
+    return NULL;
+}
+
+static const unsigned char *find_pattern_scalar(const unsigned char *hay, size_t len,
+                                                const unsigned char *pat, size_t pat_len) {
+    return find_pattern_scalar_impl(hay, len, pat, pat_len);
+}
+
+// Build NAME_4 ... NAME_32 from NAME_impl with the length fixed
+#define DEFINE_FIXED_KERNELS(name, attr)                                                       \
+    attr static const unsigned char *name##_4(const unsigned char *hay, size_t len,           \
+                                              const unsigned char *pat, size_t pat_len) {     \
+        (void)pat_len;                                                                         \
+        return name##_impl(hay, len, pat, 4);                                                 \
+    }                                                                                          \
+    attr static const unsigned char *name##_8(const unsigned char *hay, size_t len,           \
+                                              const unsigned char *pat, size_t pat_len) {     \
+        (void)pat_len;                                                                         \
+        return name##_impl(hay, len, pat, 8);                                                 \
+    }                                                                                          \
+    attr static const unsigned char *name##_16(const unsigned char *hay, size_t len,          \
+                                               const unsigned char *pat, size_t pat_len) {    \
+        (void)pat_len;                                                                         \
+        return name##_impl(hay, len, pat, 16);                                                \
+    }                                                                                          \
+    attr static const unsigned char *name##_32(const unsigned char *hay, size_t len,          \
+                                               const unsigned char *pat, size_t pat_len) {    \
+        (void)pat_len;                                                                         \
+        return name##_impl(hay, len, pat, 32);                                                \
     }
+
+DEFINE_FIXED_KERNELS(find_pattern_scalar, )
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+KERNEL_INLINE const unsigned char *find_pattern_sse2_impl(const unsigned char *hay, size_t len,
+                                                          const unsigned char *pat, size_t pat_len) {
+    if (pat_len < 2 || len < pat_len) return find_pattern_scalar(hay, len, pat, pat_len);
     
-    printf("\nTotal occurrences found: %d\n", total_found);
+    const __m128i first = _mm_set1_epi8((char)pat[0]);
+    const __m128i last = _mm_set1_epi8((char)pat[pat_len - 1]);
+    size_t i = 0;
+    for (; i + pat_len - 1 + 16 <= len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(hay + i + pat_len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                        _mm_cmpeq_epi8(block_last, last)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (pattern_equal(hay + i + bit, pat, pat_len)) return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_pattern_scalar(hay + i, len - i, pat, pat_len);
+}
+
+__attribute__((target("sse2")))
+static const unsigned char *find_pattern_sse2(const unsigned char *hay, size_t len,
+                                              const unsigned char *pat, size_t pat_len) {
+    return find_pattern_sse2_impl(hay, len, pat, pat_len);
+}
+
+DEFINE_FIXED_KERNELS(find_pattern_sse2, __attribute__((target("sse2"))))
+
+__attribute__((target("avx2")))
+KERNEL_INLINE const unsigned char *find_pattern_avx2_impl(const unsigned char *hay, size_t len,
+                                                          const unsigned char *pat, size_t pat_len) {
+    if (pat_len < 2 || len < pat_len) return find_pattern_scalar(hay, len, pat, pat_len);
     
-    // Optionally dump interesting memory regions
-    if (total_found > 0) {
-        printf("\nDumping memory regions where pattern was found...\n");
-        for (int i = 0; i < region_count; i++) {
-            if (strstr(regions[i].pathname, "heap") || 
-                strstr(regions[i].pathname, "stack") ||
-                regions[i].pathname[0] == '\0') { // anonymous mappings
-                char dump_filename[256];
-                sprintf(dump_filename, "dump_region_%d.bin", i);
-                dump_memory_region(target_pid, &regions[i], dump_filename);
-            }
+    const __m256i first = _mm256_set1_epi8((char)pat[0]);
+    const __m256i last = _mm256_set1_epi8((char)pat[pat_len - 1]);
+    size_t i = 0;
+    for (; i + pat_len - 1 + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(hay + i + pat_len - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                             _mm256_cmpeq_epi8(block_last, last)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (pattern_equal(hay + i + bit, pat, pat_len)) return hay + i + bit;
+            mask &= mask - 1;
         }
     }
+    return find_pattern_sse2(hay + i, len - i, pat, pat_len);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *find_pattern_avx2(const unsigned char *hay, size_t len,
+                                              const unsigned char *pat, size_t pat_len) {
+    return find_pattern_avx2_impl(hay, len, pat, pat_len);
+}
+
+DEFINE_FIXED_KERNELS(find_pattern_avx2, __attribute__((target("avx2"))))
+
+__attribute__((target("avx512f,avx512bw")))
+KERNEL_INLINE const unsigned char *find_pattern_avx512_impl(const unsigned char *hay, size_t len,
+                                                            const unsigned char *pat, size_t pat_len) {
+    if (pat_len < 2 || len < pat_len) return find_pattern_scalar(hay, len, pat, pat_len);
     
-    // Detach from target process
-    #ifdef __APPLE__
-    ptrace(PT_DETACH, target_pid, 0, 0);
-    #else
-    ptrace(PTRACE_DETACH, target_pid, NULL, NULL);
+    const __m512i first = _mm512_set1_epi8((char)pat[0]);
+    const __m512i last = _mm512_set1_epi8((char)pat[pat_len - 1]);
+    size_t i = 0;
+    for (; i + pat_len - 1 + 64 <= len; i += 64) {
+        __m512i block_first = _mm512_loadu_si512((const void *)(hay + i));
+        __m512i block_last = _mm512_loadu_si512((const void *)(hay + i + pat_len - 1));
+        __mmask64 mask = _mm512_mask_cmpeq_epi8_mask(_mm512_cmpeq_epi8_mask(block_first, first),
+                                                     block_last, last);
+        while (mask) {
+            unsigned bit = __builtin_ctzll(mask);
+            if (pattern_equal(hay + i + bit, pat, pat_len)) return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_pattern_avx2(hay + i, len - i, pat, pat_len);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static const unsigned char *find_pattern_avx512(const unsigned char *hay, size_t len,
+                                                const unsigned char *pat, size_t pat_len) {
+    return find_pattern_avx512_impl(hay, len, pat, pat_len);
+}
+
+DEFINE_FIXED_KERNELS(find_pattern_avx512, __attribute__((target("avx512f,avx512bw"))))
+#endif
+
+#define SCAN_KERNEL(label, name) \
+    (ScanKernel){ label, name, { name##_4, name##_8, name##_16, name##_32 } }
+
+static ScanKernel scan_kernel = SCAN_KERNEL("scalar", find_pattern_scalar);
+
+// Pick the widest kernel this CPU can run
+void select_scan_kernel(void) {
+    #ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        scan_kernel = SCAN_KERNEL("avx512", find_pattern_avx512);
+    } else if (__builtin_cpu_supports("avx2")) {
+        scan_kernel = SCAN_KERNEL("avx2", find_pattern_avx2);
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_kernel = SCAN_KERNEL("sse2", find_pattern_sse2);
+    }
     #endif
-    printf("Detached from target process\n");
+}
+
+// The selected kernel's build for patterns of pat_len bytes
+FindPatternFn scan_kernel_for(size_t pat_len) {
+    switch (pat_len) {
+    case 4: return scan_kernel.find_fixed[0];
+    case 8: return scan_kernel.find_fixed[1];
+    case 16: return scan_kernel.find_fixed[2];
+    case 32: return scan_kernel.find_fixed[3];
+    default: return scan_kernel.find;
+    }
+}
+
+// ---- Masked patterns ----
+//
+// A single pattern may leave bytes or bits open: "??" matches any byte,
+// "8?" or "?8" any byte with that high or low nibble, and "XX/MM" any byte
+// b with (b & MM) == XX. The longest run of fully literal bytes is searched
+// for with the scan kernel, and only where it hits is the whole pattern
+// compared under its mask.
+
+typedef struct {
+    unsigned char *bytes; // Already and-ed with the mask
+    unsigned char *mask;  // NULL when every bit is literal
+    size_t len;
+    size_t anchor_off;    // Longest literal run, searched for first
+    size_t anchor_len;    // 0 when no byte is fully literal
+} SearchPattern;
+
+void search_pattern_free(SearchPattern *pattern) {
+    free(pattern->bytes);
+    free(pattern->mask);
+    memset(pattern, 0, sizeof(*pattern));
+}
+
+static int hex_nibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Pick the literal anchor; a pattern without wildcards drops its mask
+static void search_pattern_anchor(SearchPattern *pattern) {
+    size_t run = 0;
+    pattern->anchor_off = pattern->anchor_len = 0;
+    for (size_t i = 0; i < pattern->len; i++) {
+        run = (pattern->mask[i] == 0xff) ? run + 1 : 0;
+        if (run > pattern->anchor_len) {
+            pattern->anchor_len = run;
+            pattern->anchor_off = i + 1 - run;
+        }
+    }
+    if (pattern->anchor_len == pattern->len) {
+        free(pattern->mask);
+        pattern->mask = NULL;
+    }
+}
+
+// Parse "4a ?? 32 8? d1/f1" (separators optional). Returns -1 on bad
+// syntax or an empty pattern.
+int parse_search_pattern(const char *text, SearchPattern *pattern) {
+    size_t max = strlen(text) / 2 + 1;
+    memset(pattern, 0, sizeof(*pattern));
+    pattern->bytes = malloc(max);
+    pattern->mask = malloc(max);
+    if (!pattern->bytes || !pattern->mask) {
+        search_pattern_free(pattern);
+        return -1;
+    }
+    
+    const char *c = text;
+    while (*c) {
+        if (*c == ' ' || *c == '\t' || *c == ',' || *c == '\n' || *c == '\r') {
+            c++;
+            continue;
+        }
+        unsigned char byte = 0, mask = 0;
+        for (int half = 0; half < 2; half++, c++) {
+            int nibble = hex_nibble(*c);
+            if (*c == '?') continue;
+            if (nibble < 0) {
+                search_pattern_free(pattern);
+                return -1;
+            }
+            byte |= nibble << (half ? 0 : 4);
+            mask |= 0x0f << (half ? 0 : 4);
+        }
+        if (*c == '/') {
+            int high = hex_nibble(c[1]), low = high >= 0 ? hex_nibble(c[2]) : -1;
+            if (low < 0) {
+                search_pattern_free(pattern);
+                return -1;
+            }
+            mask &= (unsigned char)(high << 4 | low);
+            c += 3;
+        }
+        pattern->bytes[pattern->len] = byte & mask;
+        pattern->mask[pattern->len++] = mask;
+    }
+    if (pattern->len == 0) {
+        search_pattern_free(pattern);
+        return -1;
+    }
+    search_pattern_anchor(pattern);
+    return 0;
+}
+
+void print_search_pattern(const SearchPattern *pattern) {
+    for (size_t i = 0; i < pattern->len; i++) {
+        unsigned char byte = pattern->bytes[i], mask = pattern->mask ? pattern->mask[i] : 0xff;
+        if (mask == 0xff) printf("%02x ", byte);
+        else if (mask == 0x00) printf("?? ");
+        else if (mask == 0xf0) printf("%x? ", byte >> 4);
+        else if (mask == 0x0f) printf("?%x ", byte & 0x0f);
+        else printf("%02x/%02x ", byte, mask);
+    }
+}
+
+static inline int masked_equal(const unsigned char *p, const SearchPattern *pattern) {
+    for (size_t i = 0; i < pattern->len; i++) {
+        if ((p[i] & pattern->mask[i]) != pattern->bytes[i]) return 0;
+    }
+    return 1;
+}
+
+// First match of the whole pattern inside [hay, hay + len)
+static const unsigned char *find_search_pattern(const unsigned char *hay, size_t len,
+                                                const SearchPattern *pattern) {
+    if (!pattern->mask) return scan_kernel_for(pattern->len)(hay, len, pattern->bytes, pattern->len);
+    if (len < pattern->len) return NULL;
+    
+    const unsigned char *last = hay + len - pattern->len; // Last possible start
+    if (pattern->anchor_len == 0) {
+        for (const unsigned char *p = hay; p <= last; p++) {
+            if (masked_equal(p, pattern)) return p;
+        }
+        return NULL;
+    }
+    
+    // The anchor sits at anchor_off inside every candidate
+    const unsigned char *from = hay + pattern->anchor_off;
+    const unsigned char *end = last + pattern->anchor_off + pattern->anchor_len;
+    const unsigned char *hit;
+    FindPatternFn find = scan_kernel_for(pattern->anchor_len);
+    while (from < end &&
+           (hit = find(from, end - from, pattern->bytes + pattern->anchor_off, pattern->anchor_len))) {
+        const unsigned char *start = hit - pattern->anchor_off;
+        if (masked_equal(start, pattern)) return start;
+        from = hit + 1;
+    }
+    return NULL;
+}
+
+// ---- Multi-pattern search (Aho-Corasick) ----
+//
+// All patterns are compiled into one automaton and matched in a single
+// pass. States at depth 0 and 1 get full 256-entry transition rows; deeper
+// states keep only their sorted child edges and fall back through failure
+// links, which keeps memory linear in the total pattern length. A second
+// copy of the rows lets the scan loop run on one table load per byte while
+// it stays in shallow states that have nothing to report.
+
+#define AC_DENSE_DEPTH 1
+
+typedef struct {
+    char *label;
+    unsigned char *bytes;
+    size_t len;
+    int next_same_end; // Next pattern ending in the same state, or -1
+} Pattern;
+
+typedef struct {
+    int fail;
+    int output;     // First pattern ending here, or -1
+    int dict;       // Nearest state on the fail chain with output, or -1
+    int dense_row;  // Row in PatternSet.dense, or -1
+    int depth;
+    unsigned edge_start;
+    unsigned edge_count;
+} AcState;
+
+typedef struct {
+    unsigned char byte;
+    int target;
+} AcEdge;
+
+typedef struct {
+    Pattern *patterns;
+    size_t count;
+    size_t max_len;
+    
+    AcState *states;
+    size_t state_count;
+    AcEdge *edges;    // Children of each state, sorted by byte
+    int *dense;       // 256 transitions per shallow state
+    int *fast;        // Same rows: next row if it has no output, else ~next state
+    int *dense_state; // State of each dense row
+} PatternSet;
+
+static int ac_child(const PatternSet *set, int state, unsigned char byte) {
+    const AcState *st = &set->states[state];
+    unsigned lo = st->edge_start, hi = st->edge_start + st->edge_count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (set->edges[mid].byte == byte) return set->edges[mid].target;
+        if (set->edges[mid].byte < byte) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+static inline int ac_step(const PatternSet *set, int state, unsigned char byte) {
+    for (;;) {
+        const AcState *st = &set->states[state];
+        if (st->dense_row >= 0) return set->dense[st->dense_row * 256 + byte];
+        int next = ac_child(set, state, byte);
+        if (next >= 0) return next;
+        state = st->fail;
+    }
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const AcEdge *x = a, *y = b;
+    return (int)x->byte - (int)y->byte;
+}
+
+// Build the automaton from set->patterns. Returns -1 on allocation failure.
+static int pattern_set_compile(PatternSet *set) {
+    size_t max_states = 1;
+    for (size_t i = 0; i < set->count; i++) max_states += set->patterns[i].len;
+    
+    // Trie with sibling lists first, then flattened into sorted edge arrays
+    int *first_child = malloc(max_states * sizeof(int));
+    int *next_sibling = malloc(max_states * sizeof(int));
+    unsigned char *node_byte = malloc(max_states);
+    set->states = calloc(max_states, sizeof(AcState));
+    set->edges = malloc(max_states * sizeof(AcEdge));
+    int *queue = malloc(max_states * sizeof(int));
+    if (!first_child || !next_sibling || !node_byte || !set->states || !set->edges || !queue) {
+        free(first_child); free(next_sibling); free(node_byte); free(queue);
+        return -1;
+    }
+    
+    set->state_count = 1;
+    first_child[0] = -1;
+    set->states[0].output = -1;
+    for (size_t p = 0; p < set->count; p++) {
+        int state = 0;
+        for (size_t i = 0; i < set->patterns[p].len; i++) {
+            unsigned char byte = set->patterns[p].bytes[i];
+            int child = first_child[state];
+            while (child >= 0 && node_byte[child] != byte) child = next_sibling[child];
+            if (child < 0) {
+                child = set->state_count++;
+                node_byte[child] = byte;
+                first_child[child] = -1;
+                next_sibling[child] = first_child[state];
+                first_child[state] = child;
+                set->states[child].output = -1;
+                set->states[child].depth = set->states[state].depth + 1;
+            }
+            state = child;
+        }
+        set->patterns[p].next_same_end = set->states[state].output;
+        set->states[state].output = p;
+    }
+    
+    unsigned edge_count = 0;
+    size_t dense_rows = 0;
+    for (size_t s = 0; s < set->state_count; s++) {
+        AcState *st = &set->states[s];
+        st->edge_start = edge_count;
+        for (int c = first_child[s]; c >= 0; c = next_sibling[c]) {
+            set->edges[edge_count].byte = node_byte[c];
+            set->edges[edge_count].target = c;
+            edge_count++;
+        }
+        st->edge_count = edge_count - st->edge_start;
+        qsort(set->edges + st->edge_start, st->edge_count, sizeof(AcEdge), compare_edges);
+        st->dense_row = (st->depth <= AC_DENSE_DEPTH) ? (int)dense_rows++ : -1;
+    }
+    free(first_child);
+    free(next_sibling);
+    free(node_byte);
+    
+    set->dense = malloc(dense_rows * 256 * sizeof(int));
+    set->fast = malloc(dense_rows * 256 * sizeof(int));
+    set->dense_state = malloc(dense_rows * sizeof(int));
+    if (!set->dense || !set->fast || !set->dense_state) {
+        free(queue);
+        return -1;
+    }
+    
+    // Breadth-first: failure links, output links and dense rows. A state's
+    // fail target is always shallower, so its row is ready when needed.
+    size_t head = 0, tail = 0;
+    queue[tail++] = 0;
+    set->states[0].fail = 0;
+    set->states[0].dict = -1;
+    while (head < tail) {
+        int s = queue[head++];
+        AcState *st = &set->states[s];
+        
+        for (unsigned e = st->edge_start; e < st->edge_start + st->edge_count; e++) {
+            int child = set->edges[e].target;
+            AcState *ct = &set->states[child];
+            if (s == 0) {
+                ct->fail = 0;
+            } else {
+                ct->fail = ac_step(set, st->fail, set->edges[e].byte);
+            }
+            AcState *ft = &set->states[ct->fail];
+            ct->dict = (ft->output >= 0) ? ct->fail : ft->dict;
+            queue[tail++] = child;
+        }
+        
+        if (st->dense_row >= 0) {
+            int *row = set->dense + (size_t)st->dense_row * 256;
+            for (int byte = 0; byte < 256; byte++) {
+                int child = ac_child(set, s, byte);
+                if (child >= 0) row[byte] = child;
+                else row[byte] = (s == 0) ? 0 : ac_step(set, st->fail, byte);
+            }
+        }
+    }
+    free(queue);
+    
+    for (size_t s = 0; s < set->state_count; s++) {
+        int dense_row = set->states[s].dense_row;
+        if (dense_row < 0) continue;
+        set->dense_state[dense_row] = s;
+        for (int byte = 0; byte < 256; byte++) {
+            int next = set->dense[(size_t)dense_row * 256 + byte];
+            const AcState *nt = &set->states[next];
+            int quiet = nt->dense_row >= 0 && nt->output < 0 && nt->dict < 0;
+            set->fast[(size_t)dense_row * 256 + byte] = quiet ? nt->dense_row : ~next;
+        }
+    }
+    return 0;
+}
+
+void pattern_set_free(PatternSet *set) {
+    for (size_t i = 0; i < set->count; i++) {
+        free(set->patterns[i].label);
+        free(set->patterns[i].bytes);
+    }
+    free(set->patterns);
+    free(set->states);
+    free(set->edges);
+    free(set->dense);
+    free(set->fast);
+    free(set->dense_state);
+    memset(set, 0, sizeof(*set));
+}
+
+// Parse hex bytes ("4a 7f 32" or "4a7f32") into out. Returns the byte
+// count, or -1 on a bad digit or an odd number of digits.
+static long parse_hex_bytes(const char *text, unsigned char *out, size_t max) {
+    size_t count = 0;
+    int high = -1;
+    for (const char *c = text; *c; c++) {
+        if (*c == ' ' || *c == '\t' || *c == ',') continue;
+        int nibble;
+        if (*c >= '0' && *c <= '9') nibble = *c - '0';
+        else if (*c >= 'a' && *c <= 'f') nibble = *c - 'a' + 10;
+        else if (*c >= 'A' && *c <= 'F') nibble = *c - 'A' + 10;
+        else return -1;
+        
+        if (high < 0) {
+            high = nibble;
+        } else {
+            if (count >= max) return -1;
+            out[count++] = (unsigned char)(high << 4 | nibble);
+            high = -1;
+        }
+    }
+    return high < 0 ? (long)count : -1;
+}
+
+// Load one pattern per line: "[label:] hex bytes". Blank lines and text
+// after '#' are ignored. Returns 0 and a compiled set on success.
+int load_pattern_file(const char *filename, PatternSet *set) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("fopen patterns");
+        return -1;
+    }
+    
+    memset(set, 0, sizeof(*set));
+    size_t capacity = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    int line_no = 0;
+    int ok = 1;
+    
+    while (ok && (line_len = getline(&line, &line_cap, file)) != -1) {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+        
+        char *hex = line;
+        char *label = NULL;
+        char *colon = strchr(line, ':');
+        if (colon) {
+            *colon = '\0';
+            label = line;
+            hex = colon + 1;
+            while (*label == ' ' || *label == '\t') label++;
+        }
+        
+        unsigned char *bytes = malloc(strlen(hex) / 2 + 1);
+        long len = bytes ? parse_hex_bytes(hex, bytes, strlen(hex) / 2 + 1) : -1;
+        if (len <= 0) {
+            free(bytes);
+            if (len == 0 && !label) continue; // Blank or comment-only line
+            printf("%s:%d: invalid pattern\n", filename, line_no);
+            ok = 0;
+            break;
+        }
+        
+        if (set->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            Pattern *grown = realloc(set->patterns, capacity * sizeof(Pattern));
+            if (!grown) {
+                free(bytes);
+                ok = 0;
+                break;
+            }
+            set->patterns = grown;
+        }
+        
+        Pattern *pattern = &set->patterns[set->count++];
+        pattern->bytes = bytes;
+        pattern->len = len;
+        if (label && *label) {
+            pattern->label = strdup(label);
+        } else {
+            pattern->label = malloc(32);
+            if (pattern->label) sprintf(pattern->label, "line %d", line_no);
+        }
+        if (!pattern->label) ok = 0;
+        if (pattern->len > set->max_len) set->max_len = pattern->len;
+    }
+    
+    free(line);
+    fclose(file);
+    
+    if (ok && set->count == 0) {
+        printf("%s: no patterns found\n", filename);
+        ok = 0;
+    }
+    if (ok && pattern_set_compile(set) != 0) {
+        printf("Out of memory compiling %zu patterns\n", set->count);
+        ok = 0;
+    }
+    if (!ok) {
+        pattern_set_free(set);
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t xxh64(const void *input, size_t len, uint64_t seed);
+
+// ---- Regular expressions ----
+//
+// --regex searches with a byte-level regular expression: literals, \xHH
+// and the usual escapes, . (any byte), [classes], (groups), |, *, +, ?,
+// {n,m} and a leading (?i). The expression is compiled to an NFA, forwards
+// and reversed, and run as lazily built DFAs: a state is made the first
+// time a transition reaches it and cached, up to REGEX_DFA_STATES per
+// automaton; when the cache is full it is flushed and rebuilt from the
+// current state, so memory stays bounded and the scan stays linear. An
+// unanchored forward DFA finds where the first match ends and the reversed
+// DFA walks back to its leftmost start. A match starting further left may
+// still end later, so the search's threads run on, taking no new starts,
+// until they die or are too long; whenever one reaches a match, the
+// reversed DFA finds its start, and a start further left wins. An anchored
+// forward DFA then extends the winner to the longest match. Matches are at
+// most the expression's longest match, or REGEX_MAX_MATCH bytes when that
+// is unbounded.
+
+#define REGEX_MAX_MATCH 4096
+#define REGEX_MAX_REPEAT 1000
+#define REGEX_MAX_NODES 100000
+#define REGEX_DFA_STATES 1024
+
+enum { RX_BYTES, RX_EMPTY, RX_SPLIT, RX_MATCH };
+
+typedef struct {
+    uint64_t bits[4];
+} ByteSet;
+
+typedef struct {
+    int type;
+    int out;
+    int out2; // Second branch of RX_SPLIT
+    int set;  // Byte set of RX_BYTES
+} RegexNode;
+
+typedef struct {
+    RegexNode *nodes;
+    int count;
+    int cap;
+    ByteSet *sets;
+    int set_count;
+    int set_cap;
+    int start;
+} RegexNfa;
+
+typedef struct {
+    char *source;
+    RegexNfa forward;
+    RegexNfa reverse;  // Matches the reversed strings, for finding starts
+    size_t max_len;    // Longest match reported
+} Regex;
+
+// A piece of the NFA under construction: entry node and the RX_EMPTY node
+// it leaves through, whose out is patched when the piece is joined
+typedef struct {
+    int start;
+    int exit;
+    size_t min_len;
+    size_t max_len; // SIZE_MAX when unbounded
+} RegexFrag;
+
+typedef struct {
+    const char *p;
+    RegexNfa *nfa;
+    int reverse;
+    int icase;
+    const char *error;
+} RegexParser;
+
+static inline void byte_set_add(ByteSet *set, unsigned char byte) {
+    set->bits[byte >> 6] |= 1ULL << (byte & 63);
+}
+
+static inline int byte_set_has(const ByteSet *set, unsigned char byte) {
+    return (set->bits[byte >> 6] >> (byte & 63)) & 1;
+}
+
+static void byte_set_add_range(ByteSet *set, int lo, int hi) {
+    for (int b = lo; b <= hi; b++) byte_set_add(set, (unsigned char)b);
+}
+
+static void byte_set_fold_case(ByteSet *set) {
+    for (int b = 'a'; b <= 'z'; b++) {
+        if (byte_set_has(set, b) || byte_set_has(set, b - 32)) {
+            byte_set_add(set, b);
+            byte_set_add(set, b - 32);
+        }
+    }
+}
+
+static void regex_nfa_free(RegexNfa *nfa) {
+    free(nfa->nodes);
+    free(nfa->sets);
+    memset(nfa, 0, sizeof(*nfa));
+}
+
+static int regex_node(RegexParser *ps, int type, int out, int out2, int set) {
+    RegexNfa *nfa = ps->nfa;
+    if (nfa->count >= REGEX_MAX_NODES) {
+        ps->error = "expression too large";
+        return -1;
+    }
+    if (nfa->count == nfa->cap) {
+        int cap = nfa->cap ? nfa->cap * 2 : 64;
+        RegexNode *nodes = realloc(nfa->nodes, cap * sizeof(*nodes));
+        if (!nodes) {
+            ps->error = "out of memory";
+            return -1;
+        }
+        nfa->nodes = nodes;
+        nfa->cap = cap;
+    }
+    nfa->nodes[nfa->count] = (RegexNode){ type, out, out2, set };
+    return nfa->count++;
+}
+
+static RegexFrag regex_bytes(RegexParser *ps, const ByteSet *bytes) {
+    RegexFrag frag = { -1, -1, 1, 1 };
+    RegexNfa *nfa = ps->nfa;
+    if (nfa->set_count == nfa->set_cap) {
+        int cap = nfa->set_cap ? nfa->set_cap * 2 : 16;
+        ByteSet *sets = realloc(nfa->sets, cap * sizeof(*sets));
+        if (!sets) {
+            ps->error = "out of memory";
+            return frag;
+        }
+        nfa->sets = sets;
+        nfa->set_cap = cap;
+    }
+    ByteSet set = *bytes;
+    if (ps->icase) byte_set_fold_case(&set);
+    nfa->sets[nfa->set_count] = set;
+    frag.exit = regex_node(ps, RX_EMPTY, -1, -1, -1);
+    if (frag.exit >= 0) frag.start = regex_node(ps, RX_BYTES, frag.exit, -1, nfa->set_count++);
+    return frag;
+}
+
+static RegexFrag regex_empty(RegexParser *ps) {
+    int node = regex_node(ps, RX_EMPTY, -1, -1, -1);
+    return (RegexFrag){ node, node, 0, 0 };
+}
+
+static size_t len_add(size_t a, size_t b) {
+    return (a == SIZE_MAX || b == SIZE_MAX) ? SIZE_MAX : a + b;
+}
+
+// a then b, or b then a when building the reversed NFA
+static RegexFrag regex_concat(RegexParser *ps, RegexFrag a, RegexFrag b) {
+    if (ps->reverse) {
+        RegexFrag t = a;
+        a = b;
+        b = t;
+    }
+    ps->nfa->nodes[a.exit].out = b.start;
+    return (RegexFrag){ a.start, b.exit, len_add(a.min_len, b.min_len), len_add(a.max_len, b.max_len) };
+}
+
+static RegexFrag regex_alternate(RegexParser *ps, RegexFrag a, RegexFrag b) {
+    RegexFrag frag = { -1, -1, 0, 0 };
+    frag.exit = regex_node(ps, RX_EMPTY, -1, -1, -1);
+    if (frag.exit < 0) return frag;
+    frag.start = regex_node(ps, RX_SPLIT, a.start, b.start, -1);
+    ps->nfa->nodes[a.exit].out = frag.exit;
+    ps->nfa->nodes[b.exit].out = frag.exit;
+    frag.min_len = a.min_len < b.min_len ? a.min_len : b.min_len;
+    frag.max_len = a.max_len > b.max_len ? a.max_len : b.max_len;
+    return frag;
+}
+
+// a?, or a* when loop
+static RegexFrag regex_optional(RegexParser *ps, RegexFrag a, int loop) {
+    RegexFrag frag = { -1, -1, 0, loop && a.max_len ? SIZE_MAX : a.max_len };
+    frag.exit = regex_node(ps, RX_EMPTY, -1, -1, -1);
+    if (frag.exit < 0) return frag;
+    frag.start = regex_node(ps, RX_SPLIT, a.start, frag.exit, -1);
+    ps->nfa->nodes[a.exit].out = loop ? frag.start : frag.exit;
+    return frag;
+}
+
+static RegexFrag regex_parse_alternation(RegexParser *ps);
+
+static int regex_hex_escape(RegexParser *ps) {
+    int high = hex_nibble(ps->p[0]), low = high >= 0 ? hex_nibble(ps->p[1]) : -1;
+    if (low < 0) {
+        ps->error = "bad \\x escape";
+        return -1;
+    }
+    ps->p += 2;
+    return high << 4 | low;
+}
+
+// Parse the escape after a backslash into set. Returns -1 on error.
+static int regex_parse_escape(RegexParser *ps, ByteSet *set) {
+    char c = *ps->p++;
+    int negate = (c == 'D' || c == 'W' || c == 'S');
+    ByteSet class = { { 0 } };
+    switch (c) {
+    case 'x': {
+        int byte = regex_hex_escape(ps);
+        if (byte < 0) return -1;
+        byte_set_add(set, byte);
+        return 0;
+    }
+    case 'n': byte_set_add(set, '\n'); return 0;
+    case 'r': byte_set_add(set, '\r'); return 0;
+    case 't': byte_set_add(set, '\t'); return 0;
+    case 'f': byte_set_add(set, '\f'); return 0;
+    case 'v': byte_set_add(set, '\v'); return 0;
+    case '0': byte_set_add(set, '\0'); return 0;
+    case 'd': case 'D':
+        byte_set_add_range(&class, '0', '9');
+        break;
+    case 'w': case 'W':
+        byte_set_add_range(&class, '0', '9');
+        byte_set_add_range(&class, 'A', 'Z');
+        byte_set_add_range(&class, 'a', 'z');
+        byte_set_add(&class, '_');
+        break;
+    case 's': case 'S':
+        byte_set_add_range(&class, '\t', '\r');
+        byte_set_add(&class, ' ');
+        break;
+    default:
+        if (c == '\0' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+            ps->error = "unknown escape";
+            return -1;
+        }
+        byte_set_add(set, (unsigned char)c);
+        return 0;
+    }
+    for (int w = 0; w < 4; w++) set->bits[w] |= negate ? ~class.bits[w] : class.bits[w];
+    return 0;
+}
+
+// [...] after the opening bracket
+static int regex_parse_class(RegexParser *ps, ByteSet *set) {
+    int negate = (*ps->p == '^');
+    if (negate) ps->p++;
+    int first = 1;
+    while (*ps->p != ']' || first) {
+        first = 0;
+        if (*ps->p == '\0') {
+            ps->error = "missing ]";
+            return -1;
+        }
+        int lo;
+        if (*ps->p == '\\') {
+            ps->p++;
+            ByteSet escaped = { { 0 } };
+            const char *escape = ps->p;
+            if (regex_parse_escape(ps, &escaped) != 0) return -1;
+            // Only single-byte escapes can start a range
+            if (strchr("dDwWsS", *escape) || ps->p[0] != '-' || ps->p[1] == ']') {
+                for (int w = 0; w < 4; w++) set->bits[w] |= escaped.bits[w];
+                continue;
+            }
+            for (lo = 0; !byte_set_has(&escaped, lo); lo++) {}
+        } else {
+            lo = (unsigned char)*ps->p++;
+        }
+        int hi = lo;
+        if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+            ps->p++;
+            if (*ps->p == '\\') {
+                ps->p++;
+                ByteSet escaped = { { 0 } };
+                if (strchr("dDwWsS", *ps->p)) {
+                    ps->error = "bad range";
+                    return -1;
+                }
+                if (regex_parse_escape(ps, &escaped) != 0) return -1;
+                for (hi = 0; !byte_set_has(&escaped, hi); hi++) {}
+            } else {
+                hi = (unsigned char)*ps->p++;
+            }
+            if (hi < lo) {
+                ps->error = "bad range";
+                return -1;
+            }
+        }
+        byte_set_add_range(set, lo, hi);
+    }
+    ps->p++;
+    if (ps->icase) byte_set_fold_case(set);
+    if (negate) {
+        for (int w = 0; w < 4; w++) set->bits[w] = ~set->bits[w];
+    }
+    return 0;
+}
+
+static RegexFrag regex_parse_atom(RegexParser *ps) {
+    RegexFrag bad = { -1, -1, 0, 0 };
+    ByteSet set = { { 0 } };
+    char c = *ps->p++;
+    switch (c) {
+    case '(':
+        if (ps->p[0] == '?' && ps->p[1] == ':') ps->p += 2;
+        RegexFrag inner = regex_parse_alternation(ps);
+        if (ps->error) return bad;
+        if (*ps->p != ')') {
+            ps->error = "missing )";
+            return bad;
+        }
+        ps->p++;
+        return inner;
+    case '[':
+        if (regex_parse_class(ps, &set) != 0) return bad;
+        break;
+    case '.':
+        memset(&set, 0xff, sizeof(set));
+        break;
+    case '\\':
+        if (regex_parse_escape(ps, &set) != 0) return bad;
+        break;
+    case '*': case '+': case '?':
+        ps->error = "nothing to repeat";
+        return bad;
+    case '{':
+        if (*ps->p >= '0' && *ps->p <= '9') {
+            ps->error = "nothing to repeat";
+            return bad;
+        }
+        byte_set_add(&set, '{');
+        break;
+    default:
+        byte_set_add(&set, (unsigned char)c);
+        break;
+    }
+    return regex_bytes(ps, &set);
+}
+
+// An atom with an optional quantifier. Counted repeats parse the atom
+// again for every copy.
+static RegexFrag regex_parse_repeat(RegexParser *ps) {
+    const char *atom = ps->p;
+    RegexFrag frag = regex_parse_atom(ps);
+    if (ps->error) return frag;
+
+    long min = 1, max = 1;
+    switch (*ps->p) {
+    case '*': min = 0; max = -1; ps->p++; break;
+    case '+': min = 1; max = -1; ps->p++; break;
+    case '?': min = 0; max = 1; ps->p++; break;
+    case '{': {
+        if (ps->p[1] < '0' || ps->p[1] > '9') break; // A literal '{'
+        char *end;
+        min = max = strtol(ps->p + 1, &end, 10);
+        if (*end == ',') {
+            end++;
+            if (*end == '}') max = -1;
+            else if (*end >= '0' && *end <= '9') max = strtol(end, &end, 10);
+            else max = -2;
+        }
+        if (*end != '}' || min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT || max == -2 ||
+            (max >= 0 && max < min)) {
+            ps->error = "bad {n,m} repeat";
+            return frag;
+        }
+        ps->p = end + 1;
+        break;
+    }
+    default:
+        return frag;
+    }
+    if (*ps->p && strchr("*+?{", *ps->p) && !(*ps->p == '{' && !(ps->p[1] >= '0' && ps->p[1] <= '9'))) {
+        ps->error = "nested quantifier";
+        return frag;
+    }
+    const char *after = ps->p;
+
+    // min copies, then max - min optional ones or one starred
+    RegexFrag result = (min > 0) ? frag : regex_empty(ps);
+    for (long i = 1; i < min && !ps->error; i++) {
+        ps->p = atom;
+        RegexFrag copy = regex_parse_atom(ps);
+        if (!ps->error) result = regex_concat(ps, result, copy);
+    }
+    long optional = (max < 0) ? 1 : max - min;
+    for (long i = 0; i < optional && !ps->error; i++) {
+        RegexFrag copy = frag;
+        if (min > 0 || i > 0) {
+            ps->p = atom;
+            copy = regex_parse_atom(ps);
+        }
+        if (!ps->error) copy = regex_optional(ps, copy, max < 0);
+        if (!ps->error) result = regex_concat(ps, result, copy);
+    }
+    ps->p = after;
+    return result;
+}
+
+static RegexFrag regex_parse_concat(RegexParser *ps) {
+    RegexFrag frag = regex_empty(ps);
+    while (!ps->error && *ps->p && *ps->p != '|' && *ps->p != ')') {
+        RegexFrag next = regex_parse_repeat(ps);
+        if (!ps->error) frag = regex_concat(ps, frag, next);
+    }
+    return frag;
+}
+
+static RegexFrag regex_parse_alternation(RegexParser *ps) {
+    RegexFrag frag = regex_parse_concat(ps);
+    while (!ps->error && *ps->p == '|') {
+        ps->p++;
+        RegexFrag next = regex_parse_concat(ps);
+        if (!ps->error) frag = regex_alternate(ps, frag, next);
+    }
+    return frag;
+}
+
+static const char *regex_build(const char *source, RegexNfa *nfa, int reverse, size_t *max_len) {
+    RegexParser ps = { source, nfa, reverse, 0, NULL };
+    memset(nfa, 0, sizeof(*nfa));
+    if (strncmp(ps.p, "(?i)", 4) == 0) {
+        ps.icase = 1;
+        ps.p += 4;
+    }
+    RegexFrag frag = regex_parse_alternation(&ps);
+    if (!ps.error && *ps.p) ps.error = "unmatched )";
+    if (!ps.error && frag.min_len == 0) ps.error = "matches the empty string";
+    if (!ps.error) {
+        int match = regex_node(&ps, RX_MATCH, -1, -1, -1);
+        if (match >= 0) nfa->nodes[frag.exit].out = match;
+        nfa->start = frag.start;
+    }
+    if (ps.error) {
+        regex_nfa_free(nfa);
+        return ps.error;
+    }
+    *max_len = frag.max_len;
+    return NULL;
+}
+
+// Compile source; prints the problem and returns -1 when it is invalid
+int regex_compile(Regex *regex, const char *source) {
+    memset(regex, 0, sizeof(*regex));
+    size_t max_len;
+    const char *error = regex_build(source, &regex->forward, 0, &max_len);
+    if (!error) error = regex_build(source, &regex->reverse, 1, &max_len);
+    regex->source = strdup(source);
+    if (error || !regex->source) {
+        printf("Invalid regex: %s\n", error ? error : "out of memory");
+        regex_nfa_free(&regex->forward);
+        regex_nfa_free(&regex->reverse);
+        free(regex->source);
+        return -1;
+    }
+    regex->max_len = (max_len < REGEX_MAX_MATCH) ? max_len : REGEX_MAX_MATCH;
+    return 0;
+}
+
+void regex_free(Regex *regex) {
+    regex_nfa_free(&regex->forward);
+    regex_nfa_free(&regex->reverse);
+    free(regex->source);
+    memset(regex, 0, sizeof(*regex));
+}
+
+// A lazily built DFA over one NFA. State 0.. are cached NFA node sets
+// (RX_BYTES and RX_MATCH nodes only, sorted); trans holds -1 until a
+// transition has been computed. An empty set is the dead state.
+typedef struct {
+    const RegexNfa *nfa;
+    int unanchored;        // Restart the NFA at every byte
+    int *trans;            // REGEX_DFA_STATES x 256
+    unsigned char *accept;
+    int **sets;
+    int *set_lens;
+    int count;
+    int *table;            // Hash of the sets, state ids or -1
+    int start;             // -1 until made (again, after a flush)
+    int *stack;            // Closure scratch
+    int *seeds;
+    int *found;
+    unsigned *mark;
+    unsigned generation;
+} LazyDfa;
+
+#define LAZY_DFA_TABLE (REGEX_DFA_STATES * 2)
+
+void lazy_dfa_free(LazyDfa *dfa) {
+    for (int i = 0; i < dfa->count; i++) free(dfa->sets[i]);
+    free(dfa->trans);
+    free(dfa->accept);
+    free(dfa->sets);
+    free(dfa->set_lens);
+    free(dfa->table);
+    free(dfa->stack);
+    free(dfa->seeds);
+    free(dfa->found);
+    free(dfa->mark);
+    memset(dfa, 0, sizeof(*dfa));
+}
+
+int lazy_dfa_init(LazyDfa *dfa, const RegexNfa *nfa, int unanchored) {
+    memset(dfa, 0, sizeof(*dfa));
+    dfa->nfa = nfa;
+    dfa->unanchored = unanchored;
+    dfa->start = -1;
+    dfa->trans = malloc((size_t)REGEX_DFA_STATES * 256 * sizeof(int));
+    dfa->accept = malloc(REGEX_DFA_STATES);
+    dfa->sets = malloc(REGEX_DFA_STATES * sizeof(int *));
+    dfa->set_lens = malloc(REGEX_DFA_STATES * sizeof(int));
+    dfa->table = malloc(LAZY_DFA_TABLE * sizeof(int));
+    // Every node visited pushes at most two more
+    dfa->stack = malloc((3 * (size_t)nfa->count + 2) * sizeof(int));
+    dfa->seeds = malloc((nfa->count + 1) * sizeof(int));
+    dfa->found = malloc(nfa->count * sizeof(int));
+    dfa->mark = calloc(nfa->count, sizeof(unsigned));
+    if (!dfa->trans || !dfa->accept || !dfa->sets || !dfa->set_lens || !dfa->table ||
+        !dfa->stack || !dfa->seeds || !dfa->found || !dfa->mark) {
+        lazy_dfa_free(dfa);
+        return -1;
+    }
+    memset(dfa->table, 0xff, LAZY_DFA_TABLE * sizeof(int));
+    return 0;
+}
+
+static void lazy_dfa_flush(LazyDfa *dfa) {
+    for (int i = 0; i < dfa->count; i++) free(dfa->sets[i]);
+    dfa->count = 0;
+    dfa->start = -1;
+    memset(dfa->table, 0xff, LAZY_DFA_TABLE * sizeof(int));
+}
+
+static int int_cmp(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Follow empty and split edges from the seeds into dfa->found; returns
+// the number of nodes found, sorted
+static int lazy_dfa_closure(LazyDfa *dfa, const int *seeds, int seed_count) {
+    const RegexNode *nodes = dfa->nfa->nodes;
+    if (++dfa->generation == 0) {
+        memset(dfa->mark, 0, dfa->nfa->count * sizeof(unsigned));
+        dfa->generation = 1;
+    }
+    int depth = 0, found = 0;
+    for (int i = 0; i < seed_count; i++) dfa->stack[depth++] = seeds[i];
+    while (depth > 0) {
+        int node = dfa->stack[--depth];
+        if (node < 0 || dfa->mark[node] == dfa->generation) continue;
+        dfa->mark[node] = dfa->generation;
+        switch (nodes[node].type) {
+        case RX_SPLIT:
+            dfa->stack[depth++] = nodes[node].out2;
+            // Fall through
+        case RX_EMPTY:
+            dfa->stack[depth++] = nodes[node].out;
+            break;
+        default:
+            dfa->found[found++] = node;
+        }
+    }
+    qsort(dfa->found, found, sizeof(int), int_cmp);
+    return found;
+}
+
+// The state for the node set in dfa->found, made if new. *flushed is set
+// when the cache had to be emptied to make room.
+static int lazy_dfa_state(LazyDfa *dfa, int len, int *flushed) {
+    uint64_t hash = xxh64(dfa->found, len * sizeof(int), 0);
+    size_t slot = hash % LAZY_DFA_TABLE;
+    for (int id; (id = dfa->table[slot]) >= 0; slot = (slot + 1) % LAZY_DFA_TABLE) {
+        if (dfa->set_lens[id] == len && memcmp(dfa->sets[id], dfa->found, len * sizeof(int)) == 0) {
+            return id;
+        }
+    }
+
+    *flushed = 0;
+    int *set = malloc((len ? len : 1) * sizeof(int));
+    if (!set) return -1;
+    if (dfa->count == REGEX_DFA_STATES) {
+        lazy_dfa_flush(dfa);
+        *flushed = 1;
+        slot = hash % LAZY_DFA_TABLE;
+    }
+    int id = dfa->count++;
+    memcpy(set, dfa->found, len * sizeof(int));
+    dfa->sets[id] = set;
+    dfa->set_lens[id] = len;
+    dfa->accept[id] = 0;
+    for (int i = 0; i < len; i++) {
+        if (dfa->nfa->nodes[set[i]].type == RX_MATCH) dfa->accept[id] = 1;
+    }
+    memset(dfa->trans + (size_t)id * 256, 0xff, 256 * sizeof(int));
+    dfa->table[slot] = id;
+    return id;
+}
+
+int lazy_dfa_start(LazyDfa *dfa) {
+    if (dfa->start < 0) {
+        int flushed;
+        int len = lazy_dfa_closure(dfa, &dfa->nfa->start, 1);
+        dfa->start = lazy_dfa_state(dfa, len, &flushed);
+    }
+    return dfa->start;
+}
+
+// Transition not cached yet. Returns -1 only when out of memory.
+static int lazy_dfa_compute(LazyDfa *dfa, int state, unsigned char byte) {
+    const RegexNfa *nfa = dfa->nfa;
+    int seeds_len = 0;
+    int *seeds = dfa->seeds;
+    for (int i = 0; i < dfa->set_lens[state]; i++) {
+        const RegexNode *node = &nfa->nodes[dfa->sets[state][i]];
+        if (node->type == RX_BYTES && byte_set_has(&nfa->sets[node->set], byte)) {
+            seeds[seeds_len++] = node->out;
+        }
+    }
+    if (dfa->unanchored) seeds[seeds_len++] = nfa->start;
+
+    int len = lazy_dfa_closure(dfa, seeds, seeds_len);
+    int flushed = 0;
+    int next = lazy_dfa_state(dfa, len, &flushed);
+    if (next >= 0 && !flushed) dfa->trans[(size_t)state * 256 + byte] = next;
+    if (flushed) dfa->start = -1;
+    return next;
+}
+
+static inline int lazy_dfa_step(LazyDfa *dfa, int state, unsigned char byte) {
+    int next = dfa->trans[(size_t)state * 256 + byte];
+    return next >= 0 ? next : lazy_dfa_compute(dfa, state, byte);
+}
+
+// The three automata one scan thread runs a regex with
+typedef struct {
+    LazyDfa search;   // Unanchored, forward: where matches end
+    LazyDfa reverse;  // Anchored, backward: where they start
+    LazyDfa extend;   // Anchored, forward: earlier starts, and how far matches go
+} RegexMatcher;
+
+void regex_matcher_free(RegexMatcher *matcher) {
+    lazy_dfa_free(&matcher->search);
+    lazy_dfa_free(&matcher->reverse);
+    lazy_dfa_free(&matcher->extend);
+}
+
+int regex_matcher_init(RegexMatcher *matcher, const Regex *regex) {
+    memset(matcher, 0, sizeof(*matcher));
+    if (lazy_dfa_init(&matcher->search, &regex->forward, 1) != 0 ||
+        lazy_dfa_init(&matcher->reverse, &regex->reverse, 0) != 0 ||
+        lazy_dfa_init(&matcher->extend, &regex->forward, 0) != 0) {
+        regex_matcher_free(matcher);
+        return -1;
+    }
+    return 0;
+}
+
+// ---- Typed values ----
+//
+// --value=TYPE:SPEC looks for numbers instead of bytes: i8 to i64, u8 to
+// u64, f32 or f64, equal to V, in LO..HI, or (floats) within V~EPS. Every
+// predicate becomes a closed range. For integers the test is
+// (x - lo) <= span in unsigned arithmetic of the type's width, which is
+// right for signed and unsigned types alike and needs one subtract and one
+// compare per lane. Values are read at multiples of their width unless
+// --unaligned asks for every offset. 64 start positions are tested per
+// block with vector compares, one load per offset.
+
+typedef enum {
+    VALUE_INT,
+    VALUE_UINT,
+    VALUE_FLOAT
+} ValueKind;
+
+typedef struct ValueQuery ValueQuery;
+
+// Bit i set when the value starting at block + i matches
+typedef uint64_t (*ValueBlockFn)(const unsigned char *block, const ValueQuery *query);
+
+struct ValueQuery {
+    const char *type;
+    const char *spec;     // As given, for messages
+    size_t width;
+    ValueKind kind;
+    int all_offsets;      // Every byte offset, not only multiples of width
+    uint64_t lo;          // Integers: (x - lo) & bits <= span
+    uint64_t span;
+    uint64_t bits;        // All ones over width bytes
+    double flo, fhi;      // Floats, already rounded to f32 for f32
+    ValueBlockFn block;
+};
+
+static const struct {
+    const char *name;
+    const char *alias;
+    size_t width;
+    ValueKind kind;
+} value_types[] = {
+    { "i8",  "int8",    1, VALUE_INT },
+    { "u8",  "uint8",   1, VALUE_UINT },
+    { "i16", "int16",   2, VALUE_INT },
+    { "u16", "uint16",  2, VALUE_UINT },
+    { "i32", "int32",   4, VALUE_INT },
+    { "u32", "uint32",  4, VALUE_UINT },
+    { "i64", "int64",   8, VALUE_INT },
+    { "u64", "uint64",  8, VALUE_UINT },
+    { "f32", "float",   4, VALUE_FLOAT },
+    { "f64", "double",  8, VALUE_FLOAT },
+    { "ptr", "pointer", sizeof(unsigned long), VALUE_UINT },
+};
+
+// Index in value_types of the type named by the len bytes at name, or -1
+int value_type_find(const char *name, size_t len) {
+    for (size_t i = 0; i < sizeof(value_types) / sizeof(value_types[0]); i++) {
+        if ((strlen(value_types[i].name) == len && strncmp(name, value_types[i].name, len) == 0) ||
+            (strlen(value_types[i].alias) == len && strncmp(name, value_types[i].alias, len) == 0)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static inline int value_matches(const unsigned char *p, const ValueQuery *query) {
+    if (query->kind == VALUE_FLOAT) {
+        if (query->width == 4) {
+            float v;
+            memcpy(&v, p, 4);
+            return v >= (float)query->flo && v <= (float)query->fhi;
+        }
+        double v;
+        memcpy(&v, p, 8);
+        return v >= query->flo && v <= query->fhi;
+    }
+    uint64_t v = 0;
+    memcpy(&v, p, query->width); // Little-endian, like the targets we read
+    return ((v - query->lo) & query->bits) <= query->span;
+}
+
+// The byte positions where lanes of width bytes start
+static inline uint64_t value_lane_starts(size_t width) {
+    switch (width) {
+    case 1: return ~0ULL;
+    case 2: return 0x5555555555555555ULL;
+    case 4: return 0x1111111111111111ULL;
+    default: return 0x0101010101010101ULL;
+    }
+}
+
+static uint64_t value_block_scalar(const unsigned char *block, const ValueQuery *query) {
+    size_t step = query->all_offsets ? 1 : query->width;
+    uint64_t hits = 0;
+    for (size_t i = 0; i < 64; i += step) hits |= (uint64_t)value_matches(block + i, query) << i;
+    return hits;
+}
+
+#ifdef HAVE_X86_SIMD
+// All-ones lanes where x matches
+__attribute__((target("avx2")))
+static inline __m256i value_lanes_avx2(__m256i x, const ValueQuery *query) {
+    if (query->kind == VALUE_FLOAT && query->width == 4) {
+        __m256 v = _mm256_castsi256_ps(x);
+        return _mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(v, _mm256_set1_ps((float)query->flo), _CMP_GE_OQ),
+                                                 _mm256_cmp_ps(v, _mm256_set1_ps((float)query->fhi), _CMP_LE_OQ)));
+    }
+    if (query->kind == VALUE_FLOAT) {
+        __m256d v = _mm256_castsi256_pd(x);
+        return _mm256_castpd_si256(_mm256_and_pd(_mm256_cmp_pd(v, _mm256_set1_pd(query->flo), _CMP_GE_OQ),
+                                                 _mm256_cmp_pd(v, _mm256_set1_pd(query->fhi), _CMP_LE_OQ)));
+    }
+    // t <= span unsigned is max(t, span) == span; there is no 64-bit
+    // unsigned max, so flip the sign bits and compare signed
+    switch (query->width) {
+    case 1: {
+        __m256i span = _mm256_set1_epi8((char)query->span);
+        __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8((char)query->lo));
+        return _mm256_cmpeq_epi8(_mm256_max_epu8(t, span), span);
+    }
+    case 2: {
+        __m256i span = _mm256_set1_epi16((short)query->span);
+        __m256i t = _mm256_sub_epi16(x, _mm256_set1_epi16((short)query->lo));
+        return _mm256_cmpeq_epi16(_mm256_max_epu16(t, span), span);
+    }
+    case 4: {
+        __m256i span = _mm256_set1_epi32((int)query->span);
+        __m256i t = _mm256_sub_epi32(x, _mm256_set1_epi32((int)query->lo));
+        return _mm256_cmpeq_epi32(_mm256_max_epu32(t, span), span);
+    }
+    default: {
+        __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+        __m256i t = _mm256_sub_epi64(x, _mm256_set1_epi64x((long long)query->lo));
+        __m256i above = _mm256_cmpgt_epi64(_mm256_xor_si256(t, sign),
+                                           _mm256_xor_si256(_mm256_set1_epi64x((long long)query->span), sign));
+        return _mm256_xor_si256(above, _mm256_set1_epi64x(-1));
+    }
+    }
+}
+
+__attribute__((target("avx2")))
+static uint64_t value_block_avx2(const unsigned char *block, const ValueQuery *query) {
+    size_t offsets = query->all_offsets ? query->width : 1;
+    uint64_t starts = value_lane_starts(query->width);
+    uint64_t hits = 0;
+    for (size_t r = 0; r < offsets; r++) {
+        uint64_t bytes = 0;
+        for (int half = 0; half < 2; half++) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(block + r + 32 * half));
+            bytes |= (uint64_t)(uint32_t)_mm256_movemask_epi8(value_lanes_avx2(x, query)) << (32 * half);
+        }
+        hits |= (bytes & starts) << r;
+    }
+    return hits;
+}
+
+// Bytes of the lanes where x matches
+__attribute__((target("avx512f,avx512bw")))
+static inline uint64_t value_lanes_avx512(__m512i x, const ValueQuery *query) {
+    if (query->kind == VALUE_FLOAT && query->width == 4) {
+        __m512 v = _mm512_castsi512_ps(x);
+        __mmask16 k = _mm512_cmp_ps_mask(v, _mm512_set1_ps((float)query->flo), _CMP_GE_OQ) &
+                      _mm512_cmp_ps_mask(v, _mm512_set1_ps((float)query->fhi), _CMP_LE_OQ);
+        return _mm512_movepi8_mask(_mm512_maskz_set1_epi32(k, -1));
+    }
+    if (query->kind == VALUE_FLOAT) {
+        __m512d v = _mm512_castsi512_pd(x);
+        __mmask8 k = _mm512_cmp_pd_mask(v, _mm512_set1_pd(query->flo), _CMP_GE_OQ) &
+                     _mm512_cmp_pd_mask(v, _mm512_set1_pd(query->fhi), _CMP_LE_OQ);
+        return _mm512_movepi8_mask(_mm512_maskz_set1_epi64(k, -1));
+    }
+    switch (query->width) {
+    case 1:
+        return _mm512_cmple_epu8_mask(_mm512_sub_epi8(x, _mm512_set1_epi8((char)query->lo)),
+                                      _mm512_set1_epi8((char)query->span));
+    case 2: {
+        __mmask32 k = _mm512_cmple_epu16_mask(_mm512_sub_epi16(x, _mm512_set1_epi16((short)query->lo)),
+                                              _mm512_set1_epi16((short)query->span));
+        return _mm512_movepi8_mask(_mm512_maskz_set1_epi16(k, -1));
+    }
+    case 4: {
+        __mmask16 k = _mm512_cmple_epu32_mask(_mm512_sub_epi32(x, _mm512_set1_epi32((int)query->lo)),
+                                              _mm512_set1_epi32((int)query->span));
+        return _mm512_movepi8_mask(_mm512_maskz_set1_epi32(k, -1));
+    }
+    default: {
+        __mmask8 k = _mm512_cmple_epu64_mask(_mm512_sub_epi64(x, _mm512_set1_epi64((long long)query->lo)),
+                                             _mm512_set1_epi64((long long)query->span));
+        return _mm512_movepi8_mask(_mm512_maskz_set1_epi64(k, -1));
+    }
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t value_block_avx512(const unsigned char *block, const ValueQuery *query) {
+    size_t offsets = query->all_offsets ? query->width : 1;
+    uint64_t starts = value_lane_starts(query->width);
+    uint64_t hits = 0;
+    for (size_t r = 0; r < offsets; r++) {
+        __m512i x = _mm512_loadu_si512((const void *)(block + r));
+        hits |= (value_lanes_avx512(x, query) & starts) << r;
+    }
+    return hits;
+}
+#endif
+
+static ValueBlockFn select_value_kernel(void) {
+    #ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) return value_block_avx512;
+    if (__builtin_cpu_supports("avx2")) return value_block_avx2;
+    #endif
+    return value_block_scalar;
+}
+
+// Parse one bound of the query's type. Returns -1 unless all of text is a
+// number that fits.
+static int parse_value_bound(const char *text, const ValueQuery *query, uint64_t *bits, double *real) {
+    char *end;
+    errno = 0;
+    if (query->kind == VALUE_FLOAT) {
+        *real = strtod(text, &end);
+        if (query->width == 4) *real = (float)*real;
+    } else if (query->kind == VALUE_INT) {
+        long long v = strtoll(text, &end, 0);
+        long long max = (long long)(query->bits >> 1);
+        if (v > max || v < -max - 1) errno = ERANGE;
+        *bits = (uint64_t)v;
+    } else {
+        unsigned long long v = strtoull(text, &end, 0);
+        if (strchr(text, '-') || v > query->bits) errno = ERANGE;
+        *bits = v;
+    }
+    return (errno || end == text || *end) ? -1 : 0;
+}
+
+// Parse "TYPE:V", "TYPE:LO..HI" or, for floats, "TYPE:V~EPS"
+int parse_value_query(const char *text, int all_offsets, ValueQuery *query) {
+    memset(query, 0, sizeof(*query));
+    const char *colon = strchr(text, ':');
+    int t = colon ? value_type_find(text, colon - text) : -1;
+    if (t < 0) return -1;
+    query->type = value_types[t].name;
+    query->width = value_types[t].width;
+    query->kind = value_types[t].kind;
+    query->spec = colon + 1;
+    query->all_offsets = all_offsets;
+    query->bits = (query->width == 8) ? ~0ULL : (1ULL << (8 * query->width)) - 1;
+
+    char low[128], high[128];
+    const char *dots = strstr(query->spec, "..");
+    const char *tilde = strchr(query->spec, '~');
+    const char *split = dots ? dots : tilde;
+    if (strlen(query->spec) >= sizeof(low)) return -1;
+    if (split) {
+        snprintf(low, sizeof(low), "%.*s", (int)(split - query->spec), query->spec);
+        snprintf(high, sizeof(high), "%s", split + (dots ? 2 : 1));
+    } else {
+        snprintf(low, sizeof(low), "%s", query->spec);
+        snprintf(high, sizeof(high), "%s", query->spec);
+    }
+    if (tilde && (dots || query->kind != VALUE_FLOAT)) return -1;
+
+    uint64_t lo = 0, hi = 0;
+    double flo = 0, fhi = 0;
+    if (parse_value_bound(low, query, &lo, &flo) != 0 || parse_value_bound(high, query, &hi, &fhi) != 0) {
+        return -1;
+    }
+    if (query->kind == VALUE_FLOAT) {
+        if (tilde) {
+            if (!(fhi >= 0)) return -1;
+            double eps = fhi;
+            fhi = flo + eps;
+            flo = flo - eps;
+            if (query->width == 4) {
+                flo = (float)flo;
+                fhi = (float)fhi;
+            }
+        }
+        if (!(flo <= fhi)) return -1;
+        query->flo = flo;
+        query->fhi = fhi;
+    } else {
+        if (query->kind == VALUE_INT ? (long long)hi < (long long)lo : hi < lo) return -1;
+        query->lo = lo & query->bits;
+        query->span = (hi - lo) & query->bits;
+    }
+    query->block = select_value_kernel();
+    return 0;
+}
+
+// First matching value inside [hay, hay + len), hay being at addr
+static const unsigned char *find_value(const unsigned char *hay, size_t len, unsigned long addr,
+                                       const ValueQuery *query) {
+    if (len < query->width) return NULL;
+    size_t last = len - query->width; // Last possible start
+    size_t step = query->all_offsets ? 1 : query->width;
+    size_t i = query->all_offsets ? 0 : (query->width - addr % query->width) % query->width;
+
+    // A block reads up to width - 1 bytes past its 64 starts
+    for (; i + 63 <= last; i += 64) {
+        uint64_t hits = query->block(hay + i, query);
+        if (hits) return hay + i + __builtin_ctzll(hits);
+    }
+    for (; i <= last; i += step) {
+        if (value_matches(hay + i, query)) return hay + i;
+    }
+    return NULL;
+}
+
+// ---- Streaming scan stage ----
+//
+// Chunks of a region arrive in address order and may be any size. The
+// stream keeps the last (longest pattern - 1 + context) bytes of what it
+// has seen, so a match that crosses a chunk boundary is still found and
+// recorded with its full context. The stage only sees bytes, so it
+// behaves the same whatever produced the chunks.
+
+// Where the regex stage is: looking for the end of a match, running the
+// search on for a start left of the candidate, or extending the winner
+enum { RX_SEARCH, RX_CHECK, RX_EXTEND };
+
+typedef struct {
+    MemoryRegion *region;
+    const SearchPattern *pattern; // Single-pattern mode
+    PatternSet *set;              // Multi-pattern mode when non-NULL
+    int ac_state;
+    const Regex *regex;           // Regex mode when non-NULL
+    RegexMatcher *matcher;
+    const ValueQuery *value;      // Typed value mode when non-NULL
+    int rx_mode;                  // RX_SEARCH, RX_CHECK or RX_EXTEND
+    int rx_state;
+    unsigned long rx_from;        // Where the current search started
+    unsigned long rx_start;       // Leftmost match start found so far
+    unsigned long rx_end;         // Longest match end found so far
+    unsigned long stream_start;   // First byte the stream has seen
+    size_t max_len;               // Longest pattern
+    
+    MatchList *matches;
+    unsigned long report_start;   // Only matches starting in
+    unsigned long report_end;     // [report_start, report_end) are kept
+    
+    unsigned char *tail;          // Last bytes of the previous chunks
+    size_t tail_len;
+    size_t tail_cap;
+    unsigned long tail_end;       // Address just past the tail
+    unsigned char *window;        // Scratch: tail followed by the chunk head
+    size_t head_cap;
+} ScanStream;
+
+int scan_stream_init(ScanStream *stream, MemoryRegion *region,
+                     const SearchPattern *pattern, PatternSet *set,
+                     const Regex *regex, RegexMatcher *matcher, const ValueQuery *value,
+                     MatchList *matches, unsigned long report_start, unsigned long report_end) {
+    memset(stream, 0, sizeof(*stream));
+    stream->region = region;
+    stream->pattern = pattern;
+    stream->set = set;
+    stream->regex = regex;
+    stream->matcher = matcher;
+    stream->value = value;
+    stream->max_len = regex ? regex->max_len : set ? set->max_len : value ? value->width : pattern->len;
+    stream->matches = matches;
+    stream->report_start = report_start;
+    stream->report_end = report_end;
+    stream->tail_cap = stream->max_len - 1 + MATCH_CONTEXT_BYTES;
+    stream->head_cap = stream->max_len + 2 * MATCH_CONTEXT_BYTES;
+    stream->tail = malloc(stream->tail_cap);
+    stream->window = malloc(stream->tail_cap + stream->head_cap);
+    if (!stream->tail || !stream->window) {
+        free(stream->tail);
+        free(stream->window);
+        return -1;
+    }
+    return 0;
+}
+
+void scan_stream_free(ScanStream *stream) {
+    free(stream->tail);
+    free(stream->window);
+}
+
+// Record a match at data + pos if it falls in the reporting range. Matches
+// that start in, or need context from, the carried tail are recorded from
+// the window instead.
+static void scan_stream_report(ScanStream *stream, const unsigned char *data, size_t len,
+                               unsigned long addr, long pos, size_t match_len,
+                               size_t window_len, int pattern) {
+    unsigned long match_addr = addr + pos;
+    if (match_addr < stream->report_start || match_addr >= stream->report_end) return;
+    
+    if (pos < MATCH_CONTEXT_BYTES && stream->tail_len > 0) {
+        match_list_add(stream->matches, stream->region, stream->window, window_len,
+                       addr - stream->tail_len, pos + (long)stream->tail_len, match_len, pattern);
+    } else {
+        match_list_add(stream->matches, stream->region, data, len, addr, pos, match_len, pattern);
+    }
+}
+
+// First single pattern or typed value match in [hay, hay + len), hay being at addr
+static inline const unsigned char *scan_stream_find(const ScanStream *stream, const unsigned char *hay,
+                                                    size_t len, unsigned long addr) {
+    if (stream->value) return find_value(hay, len, addr, stream->value);
+    return find_search_pattern(hay, len, stream->pattern);
+}
+
+static void scan_stream_feed_single(ScanStream *stream, const unsigned char *data, size_t len,
+                                    unsigned long addr, size_t window_len) {
+    size_t pattern_len = stream->max_len;
+    size_t keep = pattern_len - 1;
+    
+    // Matches starting in the tail and ending in this chunk
+    if (keep > 0 && stream->tail_len > 0) {
+        size_t seam_start = stream->tail_len > keep ? stream->tail_len - keep : 0;
+        size_t seam_end = stream->tail_len + keep;
+        if (seam_end > window_len) seam_end = window_len;
+        
+        const unsigned char *hit = stream->window + seam_start;
+        const unsigned char *end = stream->window + seam_end;
+        unsigned long window_addr = addr - stream->tail_len;
+        while ((hit = scan_stream_find(stream, hit, end - hit, window_addr + (hit - stream->window)))) {
+            scan_stream_report(stream, data, len, addr,
+                               (long)(hit - stream->window) - (long)stream->tail_len,
+                               pattern_len, window_len, -1);
+            hit++;
+        }
+    }
+    
+    // Matches inside this chunk
+    const unsigned char *hit = data;
+    const unsigned char *end = data + len;
+    while ((hit = scan_stream_find(stream, hit, end - hit, addr + (hit - data)))) {
+        scan_stream_report(stream, data, len, addr, hit - data, pattern_len,
+                           window_len, -1);
+        hit++;
+    }
+}
+
+static void scan_stream_feed_multi(ScanStream *stream, const unsigned char *data, size_t len,
+                                   unsigned long addr, size_t window_len) {
+    const PatternSet *set = stream->set;
+    int state = stream->ac_state;
+    
+    for (size_t i = 0; i < len; i++) {
+        int row = set->states[state].dense_row;
+        if (row >= 0) {
+            // Fast path: one load per byte until a deep or reporting state
+            int next = 0;
+            while (i < len && (next = set->fast[(size_t)row * 256 + data[i]]) >= 0) {
+                row = next;
+                i++;
+            }
+            if (i == len) {
+                state = set->dense_state[row];
+                break;
+            }
+            state = ~next;
+        } else {
+            state = ac_step(set, state, data[i]);
+        }
+        const AcState *st = &set->states[state];
+        if (st->output < 0 && st->dict < 0) continue;
+        
+        for (int s = (st->output >= 0) ? state : st->dict; s >= 0; s = set->states[s].dict) {
+            for (int p = set->states[s].output; p >= 0; p = set->patterns[p].next_same_end) {
+                long pos = (long)i + 1 - (long)set->patterns[p].len;
+                scan_stream_report(stream, data, len, addr, pos, set->patterns[p].len,
+                                   window_len, p);
+            }
+        }
+    }
+    stream->ac_state = state;
+}
+
+// Byte at addr: from the chunk, or from the tail for bytes before it
+static inline unsigned char scan_stream_byte(const ScanStream *stream, const unsigned char *data,
+                                             unsigned long addr, unsigned long at) {
+    return (at >= addr) ? data[at - addr] : stream->tail[stream->tail_len - (addr - at)];
+}
+
+// Report the regex match [rx_start, rx_end) and search on from its end
+static void scan_stream_regex_report(ScanStream *stream, const unsigned char *data, size_t len,
+                                     unsigned long addr) {
+    unsigned long start = stream->rx_start, end = stream->rx_end;
+    if (start >= stream->report_start && start < stream->report_end) {
+        // Copy the match and its context out of the tail and the chunk
+        unsigned long lowest = addr - stream->tail_len;
+        if (lowest < stream->stream_start) lowest = stream->stream_start;
+        unsigned long from = (start - lowest > MATCH_CONTEXT_BYTES) ? start - MATCH_CONTEXT_BYTES : lowest;
+        unsigned long to = end + MATCH_CONTEXT_BYTES;
+        if (to > addr + len) to = addr + len;
+        for (unsigned long at = from; at < to; at++) {
+            stream->window[at - from] = scan_stream_byte(stream, data, addr, at);
+        }
+        match_list_add(stream->matches, stream->region, stream->window, to - from, from,
+                       start - from, end - start, -1);
+    }
+    stream->rx_mode = RX_SEARCH;
+    stream->rx_from = end;
+    stream->rx_state = lazy_dfa_start(&stream->matcher->search);
+}
+
+// Leftmost start of a match ending at end, searched back no further than
+// the current search start, the longest match or the bytes still held
+static unsigned long scan_stream_regex_start(ScanStream *stream, const unsigned char *data,
+                                             unsigned long addr, unsigned long end) {
+    LazyDfa *dfa = &stream->matcher->reverse;
+    unsigned long lowest = addr - stream->tail_len;
+    if (lowest < stream->stream_start) lowest = stream->stream_start;
+    if (lowest < stream->rx_from) lowest = stream->rx_from;
+    if (end - lowest > stream->max_len) lowest = end - stream->max_len;
+    
+    unsigned long start = end - 1; // The earliest end is a match, so never empty
+    int state = lazy_dfa_start(dfa);
+    for (unsigned long at = end; at > lowest && state >= 0; at--) {
+        state = lazy_dfa_step(dfa, state, scan_stream_byte(stream, data, addr, at - 1));
+        if (state < 0 || dfa->set_lens[state] == 0) break;
+        if (dfa->accept[state]) start = at - 1;
+    }
+    return start;
+}
+
+// Run the regex stage over the chunk. When last, nothing follows it, so a
+// check or an extension still going ends with the chunk.
+static void scan_stream_feed_regex(ScanStream *stream, const unsigned char *data, size_t len,
+                                   unsigned long addr, int last) {
+    RegexMatcher *matcher = stream->matcher;
+    unsigned long chunk_end = addr + len;
+    unsigned long at = addr;
+    int state = stream->rx_state;
+    
+    while (state >= 0) {
+        if (stream->rx_mode == RX_SEARCH) {
+            // Search: only the bytes before the chunk need the slow path
+            LazyDfa *dfa = &matcher->search;
+            int found = 0;
+            for (; at < addr && !found; at++) {
+                state = lazy_dfa_step(dfa, state, scan_stream_byte(stream, data, addr, at));
+                found = state >= 0 && dfa->accept[state];
+                if (state < 0) break;
+            }
+            if (!found && state >= 0) {
+                size_t i = at - addr;
+                while (i < len) {
+                    int next = dfa->trans[(size_t)state * 256 + data[i]];
+                    if (next < 0 && (next = lazy_dfa_compute(dfa, state, data[i])) < 0) break;
+                    state = next;
+                    i++;
+                    if (dfa->accept[state]) {
+                        found = 1;
+                        break;
+                    }
+                }
+                at = addr + i;
+            }
+            if (!found) break;
+            
+            // The first match ends at at: find its start, then run the
+            // search's threads on in the anchored DFA, which adds no starts
+            stream->rx_start = scan_stream_regex_start(stream, data, addr, at);
+            stream->rx_end = at;
+            stream->rx_mode = RX_CHECK;
+            LazyDfa *check = &matcher->extend;
+            int flushed;
+            memcpy(check->found, dfa->sets[state], dfa->set_lens[state] * sizeof(int));
+            state = lazy_dfa_state(check, dfa->set_lens[state], &flushed);
+        } else if (stream->rx_mode == RX_CHECK) {
+            // Check: run on until the threads die, or those started left
+            // of rx_start could only make matches longer than max_len
+            LazyDfa *dfa = &matcher->extend;
+            int done = 0;
+            while (at < chunk_end) {
+                if (at + 2 - stream->rx_start > stream->max_len) {
+                    done = 1;
+                    break;
+                }
+                state = lazy_dfa_step(dfa, state, scan_stream_byte(stream, data, addr, at));
+                at++;
+                if (state < 0 || dfa->set_lens[state] == 0) {
+                    done = 1;
+                    break;
+                }
+                // A match ends here: its start wins if it is further left
+                if (dfa->accept[state]) {
+                    unsigned long start = scan_stream_regex_start(stream, data, addr, at);
+                    if (start < stream->rx_start) {
+                        stream->rx_start = start;
+                        stream->rx_end = at;
+                    }
+                }
+            }
+            if (state < 0 || (!done && !last)) break;
+            
+            // No earlier start: extend the candidate
+            stream->rx_mode = RX_EXTEND;
+            state = lazy_dfa_start(&matcher->extend);
+            at = stream->rx_start;
+        } else {
+            // Extend: longest match from rx_start, up to max_len bytes
+            LazyDfa *dfa = &matcher->extend;
+            int done = 0;
+            for (; at < chunk_end; at++) {
+                state = lazy_dfa_step(dfa, state, scan_stream_byte(stream, data, addr, at));
+                if (state < 0 || dfa->set_lens[state] == 0) {
+                    done = 1;
+                    break;
+                }
+                if (dfa->accept[state] && at + 1 > stream->rx_end) stream->rx_end = at + 1;
+                if (at + 1 - stream->rx_start >= stream->max_len) {
+                    done = 1;
+                    break;
+                }
+            }
+            if (!done && !last) break;
+            scan_stream_regex_report(stream, data, len, addr);
+            state = stream->rx_state;
+            at = stream->rx_end;
+        }
+    }
+    stream->rx_state = state;
+}
+
+// Settle the regex match still being checked or extended when the input
+// ends, and search the bytes held after it
+void scan_stream_finish(ScanStream *stream) {
+    if (stream->regex && stream->rx_mode != RX_SEARCH) {
+        scan_stream_feed_regex(stream, NULL, 0, stream->tail_end, 1);
+    }
+}
+
+// Feed the next chunk. A chunk that does not continue the previous one
+// starts a fresh stream.
+void scan_stream_feed(const unsigned char *data, size_t len, unsigned long addr, void *ctx) {
+    ScanStream *stream = ctx;
+    
+    if (addr != stream->tail_end) {
+        scan_stream_finish(stream);
+        stream->tail_len = 0;
+        stream->ac_state = 0;
+        stream->stream_start = stream->rx_from = addr;
+        if (stream->regex) stream->rx_state = lazy_dfa_start(&stream->matcher->search);
+    }
+    
+    if (stream->regex) {
+        scan_stream_feed_regex(stream, data, len, addr, 0);
+    } else {
+        // Window over the seam: the tail followed by the first bytes of this chunk
+        size_t head = (len < stream->head_cap) ? len : stream->head_cap;
+        memcpy(stream->window, stream->tail, stream->tail_len);
+        memcpy(stream->window + stream->tail_len, data, head);
+        size_t window_len = stream->tail_len + head;
+        
+        if (stream->set) {
+            scan_stream_feed_multi(stream, data, len, addr, window_len);
+        } else {
+            scan_stream_feed_single(stream, data, len, addr, window_len);
+        }
+    }
+    
+    // Keep the last tail_cap bytes of everything seen so far
+    if (len >= stream->tail_cap) {
+        memcpy(stream->tail, data + len - stream->tail_cap, stream->tail_cap);
+        stream->tail_len = stream->tail_cap;
+    } else {
+        size_t keep = stream->tail_cap - len;
+        if (keep > stream->tail_len) keep = stream->tail_len;
+        memmove(stream->tail, stream->tail + stream->tail_len - keep, keep);
+        memcpy(stream->tail + keep, data, len);
+        stream->tail_len = keep + len;
+    }
+    stream->tail_end = addr + len;
+}
+
+// ---- Parallel region scanning ----
+//
+// Regions are cut into SCAN_SLICE_SIZE slices. Each worker starts with a
+// contiguous run of slices, takes work from the front of its own queue and,
+// once that is empty, steals from the back of the others'. Workers keep
+// their own read buffers and match lists; the lists are merged and sorted
+// by address at the end.
+
+typedef struct {
+    MemoryRegion *region;
+    unsigned long start; // Matches starting in [start, end) belong to this slice
+    unsigned long end;
+} ScanSlice;
+
+typedef struct {
+    MemoryReader *reader;
+    size_t chunk_size;
+    const SearchPattern *pattern; // Single pattern, or
+    PatternSet *set;              // pattern set when non-NULL, or
+    const Regex *regex;           // regex when non-NULL, or
+    const ValueQuery *value;      // typed value when non-NULL
+    int threads;
+    size_t max_region_bytes;      // Scan at most this much of each region (0: no limit)
+    size_t max_total_bytes;       // Scan at most this much overall (0: no limit)
+    int progress;                 // Report progress on stderr
+    int quiet;                    // Do not list the regions as they are searched
+} ScanJob;
+
+typedef struct {
+    int enabled;
+    size_t total;
+    size_t done;
+    double last_print;
+    pthread_mutex_t lock;
+} ScanProgress;
+
+typedef struct {
+    pthread_mutex_t lock;
+    ScanSlice *slices;
+    size_t head; // Owner takes from here
+    size_t tail; // Thieves take from just below here
+} SliceQueue;
+
+typedef struct ScanWorker {
+    ScanJob *job;
+    ScanProgress *progress;
+    struct ScanWorker *all;
+    int id;
+    int count;
+    SliceQueue queue;
+    ReadBuffer buffer;
+    RegexMatcher matcher;
+    MatchList matches;
+    pthread_t thread;
+} ScanWorker;
+
+int region_is_scannable(MemoryRegion *region) {
+    return region->permissions[0] == 'r';
+}
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Count a finished slice and redraw the progress line at most 5 times a second
+static void scan_progress_add(ScanProgress *progress, size_t bytes) {
+    if (!progress->enabled) return;
+    
+    pthread_mutex_lock(&progress->lock);
+    progress->done += bytes;
+    double now = now_seconds();
+    if (now - progress->last_print >= 0.2 || progress->done == progress->total) {
+        progress->last_print = now;
+        fprintf(stderr, "\rScanned %zu / %zu MB (%.0f%%)",
+                progress->done >> 20, progress->total >> 20,
+                progress->total ? 100.0 * progress->done / progress->total : 100.0);
+        if (progress->done == progress->total) fprintf(stderr, "\n");
+    }
+    pthread_mutex_unlock(&progress->lock);
+}
+
+static void scan_slice(ScanWorker *worker, ScanSlice *slice) {
+    ScanJob *job = worker->job;
+    MemoryRegion *region = slice->region;
+    size_t max_len = job->regex ? job->regex->max_len : job->set ? job->set->max_len :
+                     job->value ? job->value->width : job->pattern->len;
+    
+    // Read a little either side so boundary matches keep their context,
+    // and far enough past the end to finish matches starting inside. A
+    // regex search starts a longest match earlier, so it runs into the
+    // slice in step with the previous one.
+    unsigned long lead = slice->start - region->start;
+    size_t max_lead = job->regex ? max_len + MATCH_CONTEXT_BYTES : MATCH_CONTEXT_BYTES;
+    if (lead > max_lead) lead = max_lead;
+    unsigned long read_start = slice->start - lead;
+    unsigned long read_end = slice->end + max_len - 1 + MATCH_CONTEXT_BYTES;
+    if (read_end > region->end) read_end = region->end;
+    
+    ScanStream stream;
+    if (scan_stream_init(&stream, region, job->pattern, job->set, job->regex, &worker->matcher,
+                         job->value, &worker->matches, slice->start, slice->end) != 0) {
+        return;
+    }
+    read_range_chunks(job->reader, &worker->buffer, read_start, read_end, scan_stream_feed, &stream);
+    scan_stream_finish(&stream);
+    scan_stream_free(&stream);
+}
+
+static int slice_queue_pop(SliceQueue *queue, ScanSlice *slice) {
+    int got = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *slice = queue->slices[queue->head++];
+        got = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return got;
+}
+
+static int slice_queue_steal(SliceQueue *queue, ScanSlice *slice) {
+    int got = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *slice = queue->slices[--queue->tail];
+        got = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return got;
+}
+
+static void *scan_worker_run(void *arg) {
+    ScanWorker *worker = arg;
+    ScanSlice slice;
+    
+    for (;;) {
+        int got = slice_queue_pop(&worker->queue, &slice);
+        for (int k = 1; !got && k < worker->count; k++) {
+            got = slice_queue_steal(&worker->all[(worker->id + k) % worker->count].queue, &slice);
+        }
+        if (!got) break; // Nothing is ever re-queued, so all work is claimed
+        scan_slice(worker, &slice);
+        scan_progress_add(worker->progress, slice.end - slice.start);
+    }
+    return NULL;
+}
+
+// End of the part of a region to scan under the job's byte budgets.
+// remaining is what is left of the total budget.
+static unsigned long region_scan_end(ScanJob *job, MemoryRegion *region, size_t remaining) {
+    size_t size = region->end - region->start;
+    if (job->max_region_bytes && size > job->max_region_bytes) size = job->max_region_bytes;
+    if (job->max_total_bytes && size > remaining) size = remaining;
+    return region->start + size;
+}
+
+int scan_slices(ScanJob *job, ScanSlice *slices, size_t slice_count, MatchList *out);
+
+// Scan every scannable region and collect the matches in out, sorted by
+// address. With one thread the scan runs on the calling thread, which the
+// ptrace backend requires. Returns -1 on allocation failure.
+int scan_regions(ScanJob *job, MemoryRegion *const *regions, int region_count, MatchList *out) {
+    match_list_init(out);
+    
+    // Budgets are applied here, in the order the regions were selected, so
+    // the same bytes are scanned however many threads run
+    size_t slice_count = 0;
+    size_t remaining = job->max_total_bytes;
+    for (int i = 0; i < region_count; i++) {
+        if (!region_is_scannable(regions[i])) continue;
+        unsigned long end = region_scan_end(job, regions[i], remaining);
+        slice_count += (end - regions[i]->start + SCAN_SLICE_SIZE - 1) / SCAN_SLICE_SIZE;
+        remaining -= (job->max_total_bytes) ? end - regions[i]->start : 0;
+    }
+    
+    ScanSlice *slices = malloc((slice_count ? slice_count : 1) * sizeof(ScanSlice));
+    if (!slices) return -1;
+    
+    size_t n = 0;
+    remaining = job->max_total_bytes;
+    for (int i = 0; i < region_count; i++) {
+        MemoryRegion *region = regions[i];
+        if (!region_is_scannable(region)) continue;
+        
+        unsigned long end = region_scan_end(job, region, remaining);
+        if (end == region->start) {
+            if (!job->quiet) printf("Byte budget exhausted, skipping region: %lx-%lx\n", region->start, region->end);
+            continue;
+        }
+        remaining -= (job->max_total_bytes) ? end - region->start : 0;
+        
+        if (!job->quiet) {
+            printf("Searching region: %lx-%lx %s %s\n", 
+                   region->start, region->end, region->permissions, 
+                   region->pathname[0] ? region->pathname : "[anonymous]");
+            if (end < region->end) {
+                printf("    Byte budget: scanning first %lu of %lu bytes\n",
+                       end - region->start, region->end - region->start);
+            }
+        }
+        for (unsigned long start = region->start; start < end; start += SCAN_SLICE_SIZE) {
+            slices[n].region = region;
+            slices[n].start = start;
+            slices[n].end = (end - start > SCAN_SLICE_SIZE) ? start + SCAN_SLICE_SIZE : end;
+            n++;
+        }
+    }
+    
+    int result = scan_slices(job, slices, slice_count, out);
+    free(slices);
+    return result;
+}
+
+// Scan the given slices, which must not overlap, and collect the matches in
+// out, sorted by address. Returns -1 on allocation failure.
+int scan_slices(ScanJob *job, ScanSlice *slices, size_t slice_count, MatchList *out) {
+    match_list_init(out);
+    
+    ScanProgress progress = { job->progress, 0, 0, 0.0, PTHREAD_MUTEX_INITIALIZER };
+    for (size_t i = 0; i < slice_count; i++) progress.total += slices[i].end - slices[i].start;
+    
+    int threads = job->threads;
+    // ptrace reads only work from the thread that attached
+    if (threads < 1 || job->reader->backend == READ_BACKEND_PTRACE) threads = 1;
+    if ((size_t)threads > slice_count) threads = slice_count ? (int)slice_count : 1;
+    
+    ScanWorker *workers = calloc(threads, sizeof(ScanWorker));
+    if (!workers) return -1;
+    
+    int failed = 0, refused = 0;
+    for (int w = 0; w < threads; w++) {
+        ScanWorker *worker = &workers[w];
+        worker->job = job;
+        worker->progress = &progress;
+        worker->all = workers;
+        worker->id = w;
+        worker->count = threads;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        worker->queue.slices = slices;
+        worker->queue.head = slice_count * w / threads;
+        worker->queue.tail = slice_count * (w + 1) / threads;
+        match_list_init(&worker->matches);
+        if (read_buffer_init(&worker->buffer, job->chunk_size) != 0) failed = 1;
+        if (job->regex && regex_matcher_init(&worker->matcher, job->regex) != 0) failed = 1;
+    }
+    
+    if (!failed) {
+        if (threads == 1) {
+            scan_worker_run(&workers[0]);
+        } else {
+            job->reader->shared = 1;
+            int started = 0;
+            for (; started < threads; started++) {
+                if (pthread_create(&workers[started].thread, NULL, scan_worker_run,
+                                   &workers[started]) != 0) {
+                    break;
+                }
+            }
+            // Threads that failed to start leave their slices to be stolen
+            if (started == 0) scan_worker_run(&workers[0]);
+            for (int w = 0; w < started; w++) pthread_join(workers[w].thread, NULL);
+            refused = memory_reader_unshare(job->reader) != 0;
+        }
+    }
+    
+    for (int w = 0; w < threads; w++) {
+        if (!failed && !refused && match_list_append(out, &workers[w].matches) != 0) failed = 1;
+        match_list_free(&workers[w].matches);
+        read_buffer_free(&workers[w].buffer);
+        regex_matcher_free(&workers[w].matcher);
+        pthread_mutex_destroy(&workers[w].queue.lock);
+    }
+    free(workers);
+    pthread_mutex_destroy(&progress.lock);
+    
+    if (!failed && refused) {
+        // The reader is on ptrace now, which only this thread may use
+        match_list_free(out);
+        ScanJob single = *job;
+        single.threads = 1;
+        return scan_slices(&single, slices, slice_count, out);
+    }
+    match_list_sort(out);
+    return failed ? -1 : 0;
+}
+
+// Print how often each pattern of the set matched
+void print_pattern_hits(const PatternSet *set, const MatchList *matches) {
+    size_t *hits = calloc(set->count, sizeof(size_t));
+    if (!hits) return;
+    for (size_t i = 0; i < matches->count; i++) hits[matches->items[i].pattern]++;
+    
+    printf("\nMatches per pattern:\n");
+    for (size_t p = 0; p < set->count; p++) {
+        if (hits[p] > 0) {
+            printf("  %s: %zu\n", set->patterns[p].label, hits[p]);
+        }
+    }
+    free(hits);
+}
+
+// ---- Sparse dumps ----
+// An anonymous page that was never touched has no backing at all, yet
+// reading it makes the kernel fault in a zero page in the target. For
+// anonymous regions the dumper asks /proc/<pid>/pagemap which pages are
+// present or swapped and reads only those; the rest are left untouched in
+// the output mapping and stay holes in the file (SEEK_HOLE finds them, and
+// they read back as zeros). File-backed regions are read in full, since a
+// page that is not resident there still has file contents behind it.
+
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_SWAPPED (1ULL << 62)
+
+int region_is_anonymous(const MemoryRegion *region) {
+    return region->pathname[0] == '\0' ||
+           strcmp(region->pathname, "[heap]") == 0 ||
+           strcmp(region->pathname, "[stack]") == 0 ||
+           strncmp(region->pathname, "[anon:", 6) == 0;
+}
+
+// Read the pagemap entries for pages [addr, addr + pages * page size)
+int pagemap_read(int fd, unsigned long addr, size_t pages, unsigned long long *entries) {
+    size_t want = pages * sizeof(*entries);
+    off_t offset = (off_t)(addr / page_size) * sizeof(*entries);
+    size_t got = 0;
+    while (got < want) {
+        ssize_t n = pread(fd, (char *)entries + got, want - got, offset + got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        got += n;
+    }
+    return 0;
+}
+
+static int pagemap_resident(unsigned long long entry) {
+    return (entry & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) != 0;
+}
+
+// One request per run of resident pages, reading into the matching offset
+// of buf; returns the number of requests
+size_t pagemap_requests(const unsigned long long *entries, size_t pages, unsigned long addr,
+                        unsigned char *buf, ReadRequest *reqs) {
+    size_t nreqs = 0;
+    for (size_t p = 0; p < pages; ) {
+        if (!pagemap_resident(entries[p])) {
+            p++;
+            continue;
+        }
+        size_t run = p;
+        while (run < pages && pagemap_resident(entries[run])) run++;
+        reqs[nreqs].addr = addr + p * page_size;
+        reqs[nreqs].buf = buf + p * page_size;
+        reqs[nreqs].len = (run - p) * page_size;
+        nreqs++;
+        p = run;
+    }
+    return nreqs;
+}
+
+// Open /proc/<pid>/pagemap for an anonymous region of a live target, or
+// return -1 to read the region in full
+int pagemap_open(const MemoryReader *reader, const MemoryRegion *region) {
+    if (reader->backend == READ_BACKEND_OFFLINE || !region_is_anonymous(region)) return -1;
+    char pagemap_path[64];
+    snprintf(pagemap_path, sizeof(pagemap_path), "/proc/%d/pagemap", reader->pid);
+    return open(pagemap_path, O_RDONLY | O_CLOEXEC);
+}
+
+// Read one window of a region into buf. Returns 1 if entries now hold the
+// window's pagemap, in which case only resident pages were read and the
+// rest of buf is left as it was, or 0 if the whole window was read
+int read_window(MemoryReader *reader, int pagemap_fd, unsigned long addr, size_t window,
+                unsigned char *buf, unsigned long long *entries, ReadRequest *reqs) {
+    size_t pages = window / page_size;
+    if (pagemap_fd >= 0 && pagemap_read(pagemap_fd, addr, pages, entries) == 0) {
+        size_t nreqs = pagemap_requests(entries, pages, addr, buf, reqs);
+        read_process_memory_batch(reader, reqs, nreqs);
+        return 1;
+    }
+    read_process_memory_into(reader, addr, buf, window);
+    return 0;
+}
+
+// A region as recorded in snapshot manifests and dump containers
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint32_t index; // Position in the target's region list, names restored files
+    char permissions[8];
+    char pathname[256];
+} RegionRecord;
+
+void region_record_fill(RegionRecord *rec, const MemoryRegion *region) {
+    memset(rec, 0, sizeof(*rec));
+    rec->start = region->start;
+    rec->end = region->end;
+    rec->index = region->index;
+    snprintf(rec->permissions, sizeof(rec->permissions), "%s", region->permissions);
+    snprintf(rec->pathname, sizeof(rec->pathname), "%s", region->pathname);
+}
+
+// Raw dumps are described by an index file next to them, one line per
+// region file: "FILE START-END PERMS [PATHNAME]", addresses in hex
+#define DUMP_INDEX_NAME "dump_regions.txt"
+
+void dump_index_add(FILE *index, const char *filename, unsigned long start, unsigned long end,
+                    const char *permissions, const char *pathname) {
+    fprintf(index, "%s %lx-%lx %s %s\n", filename, start, end, permissions, pathname);
+}
+
+// Dump a region of any size. The output file is sized up front and mapped
+// window by window, and the target's memory is read straight into the
+// mapping, so each byte is copied once, from the target into the page
+// cache. (procfs refuses copy_file_range, sendfile and splice, so there is
+// no in-kernel path from /proc/<pid>/mem to a file.) Anonymous regions are
+// dumped sparsely, see above.
+void dump_memory_region(MemoryReader *reader, MemoryRegion *region, const char *filename) {
+    if (!(region->permissions[0] == 'r')) {
+        printf("Region not readable, skipping dump\n");
+        return;
+    }
+    
+    size_t region_size = region->end - region->start;
+    
+    printf("Dumping region %lx-%lx to %s (%zu bytes)\n", 
+           region->start, region->end, filename, region_size);
+    
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("open dump file");
+        return;
+    }
+    if (ftruncate(fd, region_size) != 0) {
+        perror("ftruncate dump file");
+        close(fd);
+        return;
+    }
+    
+    // Without pagemap every page is read, as for file-backed regions
+    int pagemap_fd;
+    unsigned long long *entries = NULL;
+    ReadRequest *reqs = NULL;
+    pagemap_fd = pagemap_open(reader, region);
+    if (pagemap_fd >= 0) {
+        size_t window_pages = DUMP_WINDOW_SIZE / page_size;
+        entries = malloc(window_pages * sizeof(*entries));
+        reqs = malloc(window_pages * sizeof(*reqs));
+        if (!entries || !reqs) {
+            close(pagemap_fd);
+            pagemap_fd = -1;
+        }
+    }
+    
+    size_t dumped = 0;
+    for (size_t offset = 0; offset < region_size; offset += DUMP_WINDOW_SIZE) {
+        size_t window = (region_size - offset < DUMP_WINDOW_SIZE) ? region_size - offset : DUMP_WINDOW_SIZE;
+        unsigned long addr = region->start + offset;
+        size_t pages = window / page_size;
+        
+        int sparse = pagemap_fd >= 0 && pagemap_read(pagemap_fd, addr, pages, entries) == 0;
+        if (sparse) {
+            size_t p = 0;
+            while (p < pages && !pagemap_resident(entries[p])) p++;
+            if (p == pages) continue; // Nothing resident: the whole window stays a hole
+        }
+        
+        unsigned char *out = mmap(NULL, window, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+        if (out == MAP_FAILED) {
+            perror("mmap dump file");
+            break;
+        }
+        
+        const unsigned char *mapped = NULL;
+        if (reader->backend == READ_BACKEND_OFFLINE) mapped = offline_map(reader->image, addr, addr + window);
+        if (sparse) {
+            size_t nreqs = pagemap_requests(entries, pages, addr, out, reqs);
+            for (size_t r = 0; r < nreqs; r++) dumped += reqs[r].len;
+            read_process_memory_batch(reader, reqs, nreqs);
+        } else if (mapped) {
+            // Already in memory (a capture or a loaded dump): zero pages,
+            // which include any that were not resident, stay holes
+            static const unsigned char zero_page[PAGE_SIZE_BYTES];
+            for (size_t p = 0; p < window; p += PAGE_SIZE_BYTES) {
+                if (memcmp(mapped + p, zero_page, PAGE_SIZE_BYTES) == 0) continue;
+                memcpy(out + p, mapped + p, PAGE_SIZE_BYTES);
+                dumped += PAGE_SIZE_BYTES;
+            }
+        } else {
+            ReadRequest req = { addr, out, window };
+            read_process_memory_batch(reader, &req, 1);
+            dumped += window;
+        }
+        munmap(out, window);
+    }
+    
+    if (pagemap_fd >= 0) close(pagemap_fd);
+    free(entries);
+    free(reqs);
+    close(fd);
+    if (dumped < region_size) {
+        printf("Dump completed: %s (%zu bytes resident, rest left as holes)\n", filename, dumped);
+    } else {
+        printf("Dump completed: %s\n", filename);
+    }
+}
+
+// ---- Snapshot store ----
+// Repeated dumps of the same process mostly write the same pages again. A
+// snapshot store keeps every distinct page once, keyed by a 128-bit hash
+// (XXH64 under two seeds), and records each snapshot as a manifest that
+// lists, per region, the stored page behind every page of the region. The
+// store is a directory:
+//
+//   pages.dat        stored pages, PAGE_SIZE_BYTES each, append only
+//   pages.idx        the hash of each stored page, in the same order
+//   snapshot-N.mf    one manifest per snapshot
+//
+// Pages are appended before the manifest that refers to them is written,
+// so an interrupted snapshot leaves at most some unreferenced pages. Only
+// one writer may use a store at a time.
+
+#define SNAPSHOT_MAGIC "MDSNAP1"
+#define SNAPSHOT_HOLE UINT64_MAX // Page not resident when the snapshot was taken
+#define SNAPSHOT_WINDOW_SIZE (4 * 1024 * 1024) // Region bytes read per step
+
+#define XXH_PRIME64_1 11400714785074694791ULL
+#define XXH_PRIME64_2 14029467366897019727ULL
+#define XXH_PRIME64_3 1609587929392839161ULL
+#define XXH_PRIME64_4 9650029242287828579ULL
+#define XXH_PRIME64_5 2870177450012600261ULL
+
+static inline uint64_t xxh_rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    return xxh_rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// XXH64 (little-endian hosts)
+uint64_t xxh64(const void *input, size_t len, uint64_t seed) {
+    const unsigned char *p = input;
+    const unsigned char *end = p + len;
+    uint64_t h;
+    
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        do {
+            v1 = xxh64_round(v1, xxh_read64(p));
+            v2 = xxh64_round(v2, xxh_read64(p + 8));
+            v3 = xxh64_round(v3, xxh_read64(p + 16));
+            v4 = xxh64_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+        h = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += len;
+    
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh64_round(0, xxh_read64(p));
+        h = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        h ^= (uint64_t)v * XXH_PRIME64_1;
+        h = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * XXH_PRIME64_5;
+        h = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+    }
+    
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} PageHash;
+
+static PageHash page_hash(const unsigned char *page) {
+    PageHash hash = { xxh64(page, PAGE_SIZE_BYTES, 0), xxh64(page, PAGE_SIZE_BYTES, XXH_PRIME64_3) };
+    return hash;
+}
+
+// On-disk manifest layout: a SnapshotHeader, then for each region a
+// RegionRecord followed by one uint64_t page number (or SNAPSHOT_HOLE)
+// per page of the region
+typedef struct {
+    char magic[8];
+    uint32_t region_count;
+    int32_t pid;
+    int64_t taken_at; // Unix time
+} SnapshotHeader;
+
+typedef struct {
+    PageHash hash;
+    uint64_t page; // UINT64_MAX marks an empty slot
+} SnapshotSlot;
+
+typedef struct {
+    char dir[PATH_MAX];
+    int data_fd;
+    int index_fd;
+    uint64_t page_count;
+    SnapshotSlot *slots; // Open-addressed hash -> page number
+    size_t slot_count;   // Power of two, kept at most half full
+} SnapshotStore;
+
+static int snapshot_slots_insert(SnapshotStore *store, PageHash hash, uint64_t page) {
+    if ((store->page_count + 1) * 2 > store->slot_count) {
+        size_t new_count = store->slot_count ? store->slot_count * 2 : 4096;
+        SnapshotSlot *slots = malloc(new_count * sizeof(*slots));
+        if (!slots) return -1;
+        for (size_t i = 0; i < new_count; i++) slots[i].page = UINT64_MAX;
+        for (size_t i = 0; i < store->slot_count; i++) {
+            if (store->slots[i].page == UINT64_MAX) continue;
+            size_t j = store->slots[i].hash.lo & (new_count - 1);
+            while (slots[j].page != UINT64_MAX) j = (j + 1) & (new_count - 1);
+            slots[j] = store->slots[i];
+        }
+        free(store->slots);
+        store->slots = slots;
+        store->slot_count = new_count;
+    }
+    size_t j = hash.lo & (store->slot_count - 1);
+    while (store->slots[j].page != UINT64_MAX) j = (j + 1) & (store->slot_count - 1);
+    store->slots[j].hash = hash;
+    store->slots[j].page = page;
+    return 0;
+}
+
+static uint64_t snapshot_slots_find(const SnapshotStore *store, PageHash hash) {
+    if (store->slot_count == 0) return UINT64_MAX;
+    size_t j = hash.lo & (store->slot_count - 1);
+    while (store->slots[j].page != UINT64_MAX) {
+        if (store->slots[j].hash.lo == hash.lo && store->slots[j].hash.hi == hash.hi) {
+            return store->slots[j].page;
+        }
+        j = (j + 1) & (store->slot_count - 1);
+    }
+    return UINT64_MAX;
+}
+
+void snapshot_store_close(SnapshotStore *store) {
+    if (store->data_fd >= 0) close(store->data_fd);
+    if (store->index_fd >= 0) close(store->index_fd);
+    free(store->slots);
+    store->data_fd = store->index_fd = -1;
+    store->slots = NULL;
+    store->slot_count = 0;
+}
+
+// Open or create the store in dir and load its page index
+int snapshot_store_open(SnapshotStore *store, const char *dir) {
+    memset(store, 0, sizeof(*store));
+    store->data_fd = store->index_fd = -1;
+    snprintf(store->dir, sizeof(store->dir), "%s", dir);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror("mkdir snapshot store");
+        return -1;
+    }
+    
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/pages.dat", dir);
+    store->data_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    snprintf(path, sizeof(path), "%s/pages.idx", dir);
+    store->index_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (store->data_fd < 0 || store->index_fd < 0) {
+        perror("open snapshot store");
+        snapshot_store_close(store);
+        return -1;
+    }
+    
+    // A write cut short can leave the two files at different lengths;
+    // keep only the pages both of them cover
+    struct stat data_st, index_st;
+    if (fstat(store->data_fd, &data_st) != 0 || fstat(store->index_fd, &index_st) != 0) {
+        perror("fstat snapshot store");
+        snapshot_store_close(store);
+        return -1;
+    }
+    uint64_t pages = data_st.st_size / PAGE_SIZE_BYTES;
+    if ((uint64_t)index_st.st_size / sizeof(PageHash) < pages) pages = index_st.st_size / sizeof(PageHash);
+    if (ftruncate(store->data_fd, pages * PAGE_SIZE_BYTES) != 0 ||
+        ftruncate(store->index_fd, pages * sizeof(PageHash)) != 0) {
+        perror("ftruncate snapshot store");
+        snapshot_store_close(store);
+        return -1;
+    }
+    
+    if (pages > 0) {
+        PageHash *hashes = mmap(NULL, pages * sizeof(PageHash), PROT_READ, MAP_PRIVATE, store->index_fd, 0);
+        if (hashes == MAP_FAILED) {
+            perror("mmap snapshot index");
+            snapshot_store_close(store);
+            return -1;
+        }
+        for (uint64_t p = 0; p < pages; p++) {
+            if (snapshot_slots_insert(store, hashes[p], p) != 0) {
+                printf("Out of memory loading snapshot index\n");
+                munmap(hashes, pages * sizeof(PageHash));
+                snapshot_store_close(store);
+                return -1;
+            }
+            store->page_count++;
+        }
+        munmap(hashes, pages * sizeof(PageHash));
+    }
+    lseek(store->data_fd, 0, SEEK_END);
+    lseek(store->index_fd, 0, SEEK_END);
+    return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Number of each page in the store, appending the ones not seen before
+static int snapshot_store_pages(SnapshotStore *store, const unsigned char *data, size_t pages,
+                                uint64_t *refs, size_t *new_pages) {
+    for (size_t p = 0; p < pages; p++) {
+        if (refs[p] == SNAPSHOT_HOLE) continue;
+        const unsigned char *page = data + p * PAGE_SIZE_BYTES;
+        PageHash hash = page_hash(page);
+        uint64_t found = snapshot_slots_find(store, hash);
+        if (found == UINT64_MAX) {
+            found = store->page_count;
+            if (write_all(store->data_fd, page, PAGE_SIZE_BYTES) != 0 ||
+                write_all(store->index_fd, &hash, sizeof(hash)) != 0) {
+                perror("write snapshot store");
+                return -1;
+            }
+            if (snapshot_slots_insert(store, hash, found) != 0) {
+                printf("Out of memory growing snapshot index\n");
+                return -1;
+            }
+            store->page_count++;
+            (*new_pages)++;
+        }
+        refs[p] = found;
+    }
+    return 0;
+}
+
+// Add one region to an open manifest, reading it window by window
+static int snapshot_region(SnapshotStore *store, MemoryReader *reader, const MemoryRegion *region,
+                           FILE *manifest, unsigned char *window_buf,
+                           unsigned long long *entries, ReadRequest *reqs, uint64_t *refs,
+                           size_t *total_pages, size_t *new_pages, size_t *holes) {
+    RegionRecord rec;
+    region_record_fill(&rec, region);
+    if (fwrite(&rec, sizeof(rec), 1, manifest) != 1) return -1;
+    
+    int pagemap_fd = pagemap_open(reader, region);
+    size_t region_size = region->end - region->start;
+    int failed = 0;
+    for (size_t offset = 0; offset < region_size && !failed; offset += SNAPSHOT_WINDOW_SIZE) {
+        size_t window = (region_size - offset < SNAPSHOT_WINDOW_SIZE) ? region_size - offset : SNAPSHOT_WINDOW_SIZE;
+        unsigned long addr = region->start + offset;
+        size_t pages = window / PAGE_SIZE_BYTES;
+        
+        if (read_window(reader, pagemap_fd, addr, window, window_buf, entries, reqs)) {
+            // A kernel page may hold several stored pages
+            for (size_t p = 0; p < pages; p++) {
+                refs[p] = pagemap_resident(entries[p * PAGE_SIZE_BYTES / page_size]) ? 0 : SNAPSHOT_HOLE;
+                if (refs[p] == SNAPSHOT_HOLE) (*holes)++;
+            }
+        } else {
+            memset(refs, 0, pages * sizeof(*refs));
+        }
+        
+        failed = snapshot_store_pages(store, window_buf, pages, refs, new_pages) != 0 ||
+                 fwrite(refs, sizeof(*refs), pages, manifest) != pages;
+        *total_pages += pages;
+    }
+    if (pagemap_fd >= 0) close(pagemap_fd);
+    return failed ? -1 : 0;
+}
+
+// Take a snapshot of the given regions and write its manifest into the store
+int snapshot_write(SnapshotStore *store, MemoryReader *reader, MemoryRegion *const *regions,
+                   int count) {
+    char path[PATH_MAX + 32];
+    FILE *manifest = NULL;
+    for (int n = 1; !manifest; n++) {
+        snprintf(path, sizeof(path), "%s/snapshot-%d.mf", store->dir, n);
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0 && errno == EEXIST) continue;
+        if (fd < 0 || !(manifest = fdopen(fd, "wb"))) {
+            perror("create snapshot manifest");
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    }
+    
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.region_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (regions[i]->permissions[0] == 'r') header.region_count++;
+    }
+    header.pid = reader->pid;
+    header.taken_at = time(NULL);
+    
+    size_t window_pages = SNAPSHOT_WINDOW_SIZE / PAGE_SIZE_BYTES;
+    unsigned char *window_buf = malloc(SNAPSHOT_WINDOW_SIZE);
+    unsigned long long *entries = malloc(window_pages * sizeof(*entries));
+    ReadRequest *reqs = malloc(window_pages * sizeof(*reqs));
+    uint64_t *refs = malloc(window_pages * sizeof(*refs));
+    size_t total_pages = 0, new_pages = 0, holes = 0;
+    int failed = !window_buf || !entries || !reqs || !refs ||
+                 fwrite(&header, sizeof(header), 1, manifest) != 1;
+    
+    for (int i = 0; i < count && !failed; i++) {
+        const MemoryRegion *region = regions[i];
+        if (region->permissions[0] != 'r') continue;
+        failed = snapshot_region(store, reader, region, manifest, window_buf,
+                                 entries, reqs, refs, &total_pages, &new_pages, &holes) != 0;
+    }
+    
+    free(window_buf);
+    free(entries);
+    free(reqs);
+    free(refs);
+    if (fclose(manifest) != 0) failed = 1;
+    if (failed) {
+        printf("Snapshot failed, removing %s\n", path);
+        unlink(path);
+        return -1;
+    }
+    printf("Snapshot written: %s (%zu pages, %zu new, %zu not resident, store holds %llu)\n",
+           path, total_pages, new_pages, holes, (unsigned long long)store->page_count);
+    return 0;
+}
+
+// Rebuild the region files of a snapshot as dump_region_<index>.bin in
+// the current directory, the names a live dump would have used
+int snapshot_restore(const char *manifest_path) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", manifest_path);
+    char *slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    else snprintf(dir, sizeof(dir), ".");
+    
+    FILE *manifest = fopen(manifest_path, "rb");
+    if (!manifest) {
+        perror("open snapshot manifest");
+        return -1;
+    }
+    SnapshotHeader header;
+    if (fread(&header, sizeof(header), 1, manifest) != 1 ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        printf("%s: not a snapshot manifest\n", manifest_path);
+        fclose(manifest);
+        return -1;
+    }
+    
+    char path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/pages.dat", dir);
+    int data_fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (data_fd < 0 || fstat(data_fd, &st) != 0) {
+        perror("open snapshot pages");
+        if (data_fd >= 0) close(data_fd);
+        fclose(manifest);
+        return -1;
+    }
+    uint64_t stored = st.st_size / PAGE_SIZE_BYTES;
+    const unsigned char *data = NULL;
+    if (stored > 0) {
+        data = mmap(NULL, stored * PAGE_SIZE_BYTES, PROT_READ, MAP_SHARED, data_fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap snapshot pages");
+            close(data_fd);
+            fclose(manifest);
+            return -1;
+        }
+    }
+    
+    printf("Restoring snapshot of PID %d taken at %lld (%u regions)\n",
+           header.pid, (long long)header.taken_at, header.region_count);
+    FILE *index = fopen(DUMP_INDEX_NAME, "w");
+    int failed = !index;
+    if (!index) perror("fopen " DUMP_INDEX_NAME);
+    for (uint32_t r = 0; r < header.region_count && !failed; r++) {
+        RegionRecord rec;
+        if (fread(&rec, sizeof(rec), 1, manifest) != 1) {
+            printf("%s: truncated manifest\n", manifest_path);
+            failed = 1;
+            break;
+        }
+        rec.pathname[sizeof(rec.pathname) - 1] = '\0';
+        rec.permissions[sizeof(rec.permissions) - 1] = '\0';
+        
+        char filename[64];
+        snprintf(filename, sizeof(filename), "dump_region_%u.bin", rec.index);
+        printf("Restoring region %llx-%llx %s %s to %s\n", (unsigned long long)rec.start,
+               (unsigned long long)rec.end, rec.permissions, rec.pathname, filename);
+        dump_index_add(index, filename, rec.start, rec.end, rec.permissions, rec.pathname);
+        int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0 || ftruncate(fd, rec.end - rec.start) != 0) {
+            perror("create restored region");
+            if (fd >= 0) close(fd);
+            failed = 1;
+            break;
+        }
+        
+        // Pages that were not resident, and zero pages, stay holes
+        static const unsigned char zero_page[PAGE_SIZE_BYTES];
+        uint64_t pages = (rec.end - rec.start) / PAGE_SIZE_BYTES;
+        for (uint64_t p = 0; p < pages && !failed; p++) {
+            uint64_t ref;
+            if (fread(&ref, sizeof(ref), 1, manifest) != 1 || (ref != SNAPSHOT_HOLE && ref >= stored)) {
+                printf("%s: truncated manifest or missing page\n", manifest_path);
+                failed = 1;
+            } else if (ref != SNAPSHOT_HOLE &&
+                       memcmp(data + ref * PAGE_SIZE_BYTES, zero_page, PAGE_SIZE_BYTES) != 0 &&
+                       pwrite(fd, data + ref * PAGE_SIZE_BYTES, PAGE_SIZE_BYTES,
+                              p * PAGE_SIZE_BYTES) != PAGE_SIZE_BYTES) {
+                perror("write restored region");
+                failed = 1;
+            }
+        }
+        close(fd);
+    }
+    
+    if (index) fclose(index);
+    if (data) munmap((void *)data, stored * PAGE_SIZE_BYTES);
+    close(data_fd);
+    fclose(manifest);
+    return failed ? -1 : 0;
+}
+
+// ---- Dump container ----
+// A single file holding every dumped region with its start address,
+// permissions and pathname. Region contents are cut into blocks of
+// CONTAINER_BLOCK_SIZE bytes, each compressed on its own with a small LZ
+// codec, and a block index at the end of the file maps addresses to
+// blocks, so a reader inflates only the blocks that cover the range it
+// wants. Layout:
+//
+//   ContainerHeader
+//   RegionRecord x region_count
+//   compressed blocks
+//   ContainerBlock x block_count   (at index_offset, 8-byte aligned, sorted by address)
+//
+// Blocks with no resident pages are left out and read back as zeros.
+
+#define CONTAINER_MAGIC "MDCONT1"
+#define CONTAINER_BLOCK_SIZE (64 * 1024)
+#define CONTAINER_WINDOW_SIZE (4 * 1024 * 1024) // Region bytes read per step
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+
+typedef struct {
+    char magic[8];
+    uint32_t region_count;
+    uint32_t block_size;
+    uint64_t block_count;
+    uint64_t index_offset;
+    int32_t pid;
+    uint32_t reserved;
+    int64_t taken_at; // Unix time
+} ContainerHeader;
+
+typedef struct {
+    uint64_t addr;
+    uint64_t offset;      // Of the stored bytes in the file
+    uint32_t stored_len;  // Equal to raw_len when the block is stored uncompressed
+    uint32_t raw_len;
+} ContainerBlock;
+
+// LZ codec. A block is a series of sequences, each a token byte (literal
+// count in the high nibble, match length minus LZ_MIN_MATCH in the low
+// one, 15 meaning more length bytes follow), the literals, then a 2-byte
+// little-endian match offset. The last sequence has literals only.
+
+static size_t lz_put_length(unsigned char *op, const unsigned char *oend, size_t len) {
+    size_t n = 0;
+    for (; len >= 255; len -= 255) {
+        if (op + n >= oend) return 0;
+        op[n++] = 255;
+    }
+    if (op + n >= oend) return 0;
+    op[n++] = (unsigned char)len;
+    return n;
+}
+
+// Emit one sequence; returns the new output position, or NULL if it does not fit
+static unsigned char *lz_emit(unsigned char *op, const unsigned char *oend,
+                              const unsigned char *lit, size_t lit_len,
+                              size_t offset, size_t match_len) {
+    if (op >= oend) return NULL;
+    unsigned char *token = op++;
+    size_t match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+    *token = (unsigned char)(((lit_len < 15 ? lit_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+    if (lit_len >= 15) {
+        size_t n = lz_put_length(op, oend, lit_len - 15);
+        if (n == 0) return NULL;
+        op += n;
+    }
+    if ((size_t)(oend - op) < lit_len) return NULL;
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0) return op;
+    
+    if (oend - op < 2) return NULL;
+    *op++ = (unsigned char)offset;
+    *op++ = (unsigned char)(offset >> 8);
+    if (match_code >= 15) {
+        size_t n = lz_put_length(op, oend, match_code - 15);
+        if (n == 0) return NULL;
+        op += n;
+    }
+    return op;
+}
+
+// Compress src into dst; returns the compressed size, or 0 if it would not
+// be smaller than dst_cap
+size_t lz_compress(const unsigned char *src, size_t len, unsigned char *dst, size_t dst_cap) {
+    uint32_t table[1 << LZ_HASH_BITS]; // Position + 1 of the last 4 bytes with each hash
+    memset(table, 0, sizeof(table));
+    const unsigned char *oend = dst + dst_cap;
+    unsigned char *op = dst;
+    size_t anchor = 0;
+    size_t i = 0;
+    
+    while (i + LZ_MIN_MATCH <= len) {
+        uint32_t seq;
+        memcpy(&seq, src + i, sizeof(seq));
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t cand = table[h];
+        table[h] = (uint32_t)(i + 1);
+        
+        uint32_t cand_seq;
+        if (cand == 0 || i - (cand - 1) > LZ_MAX_OFFSET ||
+            (memcpy(&cand_seq, src + cand - 1, sizeof(cand_seq)), cand_seq != seq)) {
+            i += 1 + ((i - anchor) >> 6); // Skip ahead faster through incompressible data
+            continue;
+        }
+        cand--;
+        size_t match_len = LZ_MIN_MATCH;
+        while (i + match_len < len && src[cand + match_len] == src[i + match_len]) match_len++;
+        
+        op = lz_emit(op, oend, src + anchor, i - anchor, i - cand, match_len);
+        if (!op) return 0;
+        i += match_len;
+        anchor = i;
+    }
+    op = lz_emit(op, oend, src + anchor, len - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+static int lz_get_length(const unsigned char **ip, const unsigned char *iend, size_t *len) {
+    unsigned char b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+// Decompress exactly dst_len bytes; returns 0, or -1 on malformed input
+int lz_decompress(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_len) {
+    const unsigned char *ip = src;
+    const unsigned char *iend = src + src_len;
+    size_t out = 0;
+    
+    while (ip < iend) {
+        unsigned char token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && lz_get_length(&ip, iend, &lit_len) != 0) return -1;
+        if ((size_t)(iend - ip) < lit_len || dst_len - out < lit_len) return -1;
+        memcpy(dst + out, ip, lit_len);
+        ip += lit_len;
+        out += lit_len;
+        if (ip == iend) break;
+        
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t match_len = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15 && lz_get_length(&ip, iend, &match_len) != 0) return -1;
+        if (offset == 0 || offset > out || dst_len - out < match_len) return -1;
+        
+        unsigned char *d = dst + out;
+        if (offset >= match_len) {
+            memcpy(d, d - offset, match_len);
+        } else {
+            for (size_t k = 0; k < match_len; k++) d[k] = d[k - offset];
+        }
+        out += match_len;
+    }
+    return out == dst_len ? 0 : -1;
+}
+
+typedef struct {
+    int fd;
+    uint64_t offset;        // Where the next block goes
+    ContainerBlock *blocks;
+    size_t block_count;
+    size_t block_cap;
+    size_t raw_bytes;
+    size_t stored_bytes;
+} ContainerWriter;
+
+static int container_add_block(ContainerWriter *writer, unsigned long addr,
+                               const unsigned char *raw, size_t len, unsigned char *scratch) {
+    if (writer->block_count == writer->block_cap) {
+        size_t new_cap = writer->block_cap ? writer->block_cap * 2 : 1024;
+        ContainerBlock *blocks = realloc(writer->blocks, new_cap * sizeof(*blocks));
+        if (!blocks) return -1;
+        writer->blocks = blocks;
+        writer->block_cap = new_cap;
+    }
+    
+    size_t stored = lz_compress(raw, len, scratch, len - 1);
+    const unsigned char *data = stored ? scratch : raw;
+    if (!stored) stored = len;
+    if (write_all(writer->fd, data, stored) != 0) return -1;
+    
+    ContainerBlock *block = &writer->blocks[writer->block_count++];
+    block->addr = addr;
+    block->offset = writer->offset;
+    block->stored_len = (uint32_t)stored;
+    block->raw_len = (uint32_t)len;
+    writer->offset += stored;
+    writer->raw_bytes += len;
+    writer->stored_bytes += stored;
+    return 0;
+}
+
+// Write the given regions to a new container file
+int container_write(const char *path, MemoryReader *reader, MemoryRegion *const *regions,
+                    int count) {
+    ContainerWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer.fd < 0) {
+        perror("open dump container");
+        return -1;
+    }
+    
+    ContainerHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+    header.block_size = CONTAINER_BLOCK_SIZE;
+    header.pid = reader->pid;
+    header.taken_at = time(NULL);
+    for (int i = 0; i < count; i++) {
+        if (regions[i]->permissions[0] == 'r') header.region_count++;
+    }
+    
+    int failed = write_all(writer.fd, &header, sizeof(header)) != 0;
+    for (int i = 0; i < count && !failed; i++) {
+        if (regions[i]->permissions[0] != 'r') continue;
+        RegionRecord rec;
+        region_record_fill(&rec, regions[i]);
+        failed = write_all(writer.fd, &rec, sizeof(rec)) != 0;
+    }
+    writer.offset = sizeof(header) + (uint64_t)header.region_count * sizeof(RegionRecord);
+    
+    size_t window_pages = CONTAINER_WINDOW_SIZE / page_size;
+    unsigned char *window_buf = malloc(CONTAINER_WINDOW_SIZE);
+    unsigned char *scratch = malloc(CONTAINER_BLOCK_SIZE);
+    unsigned long long *entries = malloc(window_pages * sizeof(*entries));
+    ReadRequest *reqs = malloc(window_pages * sizeof(*reqs));
+    if (!window_buf || !scratch || !entries || !reqs) failed = 1;
+    
+    for (int i = 0; i < count && !failed; i++) {
+        const MemoryRegion *region = regions[i];
+        if (region->permissions[0] != 'r') continue;
+        printf("Adding region %lx-%lx (%s) to %s\n", region->start, region->end,
+               region->pathname[0] ? region->pathname : "anonymous", path);
+        
+        int pagemap_fd = pagemap_open(reader, region);
+        size_t region_size = region->end - region->start;
+        for (size_t offset = 0; offset < region_size && !failed; offset += CONTAINER_WINDOW_SIZE) {
+            size_t window = (region_size - offset < CONTAINER_WINDOW_SIZE) ? region_size - offset : CONTAINER_WINDOW_SIZE;
+            unsigned long addr = region->start + offset;
+            memset(window_buf, 0, window);
+            int sparse = read_window(reader, pagemap_fd, addr, window, window_buf, entries, reqs);
+            
+            for (size_t b = 0; b < window && !failed; b += CONTAINER_BLOCK_SIZE) {
+                size_t len = (window - b < CONTAINER_BLOCK_SIZE) ? window - b : CONTAINER_BLOCK_SIZE;
+                if (sparse) {
+                    size_t p = b / page_size;
+                    while (p * page_size < b + len && !pagemap_resident(entries[p])) p++;
+                    if (p * page_size >= b + len) continue; // No resident pages
+                }
+                failed = container_add_block(&writer, addr + b, window_buf + b, len, scratch) != 0;
+            }
+        }
+        if (pagemap_fd >= 0) close(pagemap_fd);
+    }
+    
+    if (!failed) {
+        static const unsigned char pad[sizeof(uint64_t)];
+        size_t pad_len = (sizeof(pad) - writer.offset % sizeof(pad)) % sizeof(pad);
+        header.block_count = writer.block_count;
+        header.index_offset = writer.offset + pad_len;
+        failed = write_all(writer.fd, pad, pad_len) != 0 ||
+                 write_all(writer.fd, writer.blocks, writer.block_count * sizeof(ContainerBlock)) != 0 ||
+                 pwrite(writer.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header);
+    }
+    
+    free(window_buf);
+    free(scratch);
+    free(entries);
+    free(reqs);
+    free(writer.blocks);
+    if (close(writer.fd) != 0) failed = 1;
+    if (failed) {
+        printf("Writing %s failed, removing it\n", path);
+        unlink(path);
+        return -1;
+    }
+    printf("Container written: %s (%u regions, %zu blocks, %zu bytes stored for %zu)\n",
+           path, header.region_count, writer.block_count, writer.stored_bytes, writer.raw_bytes);
+    return 0;
+}
+
+// Read access to a container through a read-only mapping of the file
+typedef struct {
+    const unsigned char *map;
+    size_t map_size;
+    const ContainerHeader *header;
+    const RegionRecord *regions;
+    const ContainerBlock *blocks;
+} Container;
+
+void container_close(Container *container) {
+    if (container->map) munmap((void *)container->map, container->map_size);
+    memset(container, 0, sizeof(*container));
+}
+
+int container_open(Container *container, const char *path) {
+    memset(container, 0, sizeof(*container));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror("open dump container");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(ContainerHeader)) {
+        printf("%s: not a dump container\n", path);
+        close(fd);
+        return -1;
+    }
+    container->map_size = st.st_size;
+    container->map = mmap(NULL, container->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (container->map == MAP_FAILED) {
+        perror("mmap dump container");
+        container->map = NULL;
+        return -1;
+    }
+    
+    const ContainerHeader *header = (const ContainerHeader *)container->map;
+    size_t regions_end = sizeof(*header) + (size_t)header->region_count * sizeof(RegionRecord);
+    if (memcmp(header->magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) != 0 ||
+        header->block_size != CONTAINER_BLOCK_SIZE || regions_end > container->map_size ||
+        header->index_offset > container->map_size || header->index_offset % sizeof(uint64_t) != 0 ||
+        header->block_count > (container->map_size - header->index_offset) / sizeof(ContainerBlock)) {
+        printf("%s: not a dump container, or truncated\n", path);
+        container_close(container);
+        return -1;
+    }
+    container->header = header;
+    container->regions = (const RegionRecord *)(container->map + sizeof(*header));
+    container->blocks = (const ContainerBlock *)(container->map + header->index_offset);
+    for (uint32_t r = 0; r < header->region_count; r++) {
+        if (container->regions[r].end < container->regions[r].start) {
+            printf("%s: damaged region table\n", path);
+            container_close(container);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Copy [addr, addr + len) out of the container; bytes no block covers read
+// as zero. Only the blocks overlapping the range are decompressed.
+int container_read(const Container *container, unsigned long addr, unsigned char *buf, size_t len) {
+    memset(buf, 0, len);
+    unsigned long end = addr + len;
+    
+    // First block that ends after addr
+    size_t lo = 0, hi = container->header->block_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const ContainerBlock *block = &container->blocks[mid];
+        if (block->addr + block->raw_len <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    
+    unsigned char *scratch = NULL;
+    for (size_t b = lo; b < container->header->block_count; b++) {
+        const ContainerBlock *block = &container->blocks[b];
+        if (block->addr >= end) break;
+        if (block->raw_len > container->header->block_size ||
+            block->offset > container->header->index_offset ||
+            block->stored_len > container->header->index_offset - block->offset) {
+            free(scratch);
+            return -1;
+        }
+        
+        const unsigned char *raw = container->map + block->offset;
+        if (block->stored_len != block->raw_len) {
+            if (!scratch && !(scratch = malloc(container->header->block_size))) return -1;
+            if (lz_decompress(raw, block->stored_len, scratch, block->raw_len) != 0) {
+                free(scratch);
+                return -1;
+            }
+            raw = scratch;
+        }
+        unsigned long from = block->addr > addr ? block->addr : addr;
+        unsigned long to = block->addr + block->raw_len < end ? block->addr + block->raw_len : end;
+        if (to <= from) continue; // Out of order, so the index is damaged
+        memcpy(buf + (from - addr), raw + (from - block->addr), to - from);
+    }
+    free(scratch);
+    return 0;
+}
+
+// --extract: list a container's regions, or write one address range
+// ("FILE@START-END", hex) to stdout
+int container_extract(const char *spec) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", spec);
+    char *range = strrchr(path, '@');
+    unsigned long start = 0, end = 0;
+    if (range) {
+        *range++ = '\0';
+        if (sscanf(range, "%lx-%lx", &start, &end) != 2 || end <= start) {
+            fprintf(stderr, "Invalid range: %s (expected START-END in hex)\n", range);
+            return -1;
+        }
+    }
+    
+    Container container;
+    if (container_open(&container, path) != 0) return -1;
+    const ContainerHeader *header = container.header;
+    
+    if (!range) {
+        printf("Dump of PID %d taken at %lld: %u regions, %llu blocks\n", header->pid,
+               (long long)header->taken_at, header->region_count,
+               (unsigned long long)header->block_count);
+        for (uint32_t r = 0; r < header->region_count; r++) {
+            const RegionRecord *rec = &container.regions[r];
+            printf("  %llx-%llx %.8s %.256s (region %u)\n", (unsigned long long)rec->start,
+                   (unsigned long long)rec->end, rec->permissions, rec->pathname, rec->index);
+        }
+        container_close(&container);
+        return 0;
+    }
+    
+    int failed = 0;
+    unsigned char *buf = malloc(CONTAINER_BLOCK_SIZE);
+    if (!buf) failed = 1;
+    for (unsigned long addr = start; addr < end && !failed; addr += CONTAINER_BLOCK_SIZE) {
+        size_t len = (end - addr < CONTAINER_BLOCK_SIZE) ? end - addr : CONTAINER_BLOCK_SIZE;
+        if (container_read(&container, addr, buf, len) != 0) {
+            fprintf(stderr, "%s: corrupt block near %lx\n", path, addr);
+            failed = 1;
+        } else if (fwrite(buf, 1, len, stdout) != len) {
+            failed = 1;
+        }
+    }
+    free(buf);
+    container_close(&container);
+    return failed ? -1 : 0;
+}
+
+// ---- Offline scans ----
+// The scan engine can also run against earlier dumps instead of a live
+// process. Each source is mapped read-only and placed back at its original
+// addresses, and reads through READ_BACKEND_OFFLINE are served from the
+// mappings, so results carry the same addresses a live scan would report.
+// A source is a dump directory (described by its DUMP_INDEX_NAME), a dump
+// container, or a single raw file given as FILE@ADDR. Raw mappings are
+// scanned in place without copying; container regions are inflated block
+// by block.
+
+typedef struct {
+    unsigned long start;
+    unsigned long end;
+    const unsigned char *data;    // Mapping of a raw dump file, or NULL
+    const Container *container;   // Otherwise the container holding the region
+} OfflineRegion;
+
+typedef struct OfflineImage {
+    OfflineRegion *regions; // Sorted by start
+    size_t count;
+    size_t cap;
+    Container *containers;
+    size_t container_count;
+} OfflineImage;
+
+// The region holding addr, or the first one after it
+static size_t offline_find(const OfflineImage *image, unsigned long addr) {
+    size_t lo = 0, hi = image->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (image->regions[mid].end <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+const unsigned char *offline_map(const OfflineImage *image, unsigned long start, unsigned long end) {
+    size_t r = offline_find(image, start);
+    if (r == image->count) return NULL;
+    const OfflineRegion *region = &image->regions[r];
+    if (!region->data || region->start > start || region->end < end) return NULL;
+    return region->data + (start - region->start);
+}
+
+size_t offline_read_batch(const OfflineImage *image, ReadRequest *reqs, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        unsigned long addr = reqs[i].addr;
+        unsigned long end = addr + reqs[i].len;
+        memset(reqs[i].buf, 0, reqs[i].len);
+        for (size_t r = offline_find(image, addr); r < image->count && image->regions[r].start < end; r++) {
+            const OfflineRegion *region = &image->regions[r];
+            unsigned long from = region->start > addr ? region->start : addr;
+            unsigned long to = region->end < end ? region->end : end;
+            unsigned char *out = reqs[i].buf + (from - addr);
+            if (region->data) {
+                memcpy(out, region->data + (from - region->start), to - from);
+            } else if (container_read(region->container, from, out, to - from) != 0) {
+                continue; // Corrupt block: leave zeros
+            }
+            total += to - from;
+        }
+    }
+    return total;
+}
+
+static int offline_add(OfflineImage *image, RegionTable *table,
+                       unsigned long start, unsigned long end, const char *permissions,
+                       const char *pathname, const unsigned char *data, const Container *container) {
+    if (image->count == image->cap) {
+        size_t new_cap = image->cap ? image->cap * 2 : 64;
+        OfflineRegion *grown = realloc(image->regions, new_cap * sizeof(*grown));
+        if (!grown) return -1;
+        image->regions = grown;
+        image->cap = new_cap;
+    }
+    OfflineRegion *region = &image->regions[image->count++];
+    region->start = start;
+    region->end = end;
+    region->data = data;
+    region->container = container;
+    
+    MemoryRegion *out = region_table_add(table);
+    if (!out || !(out->pathname = region_table_strdup(table, pathname))) return -1;
+    out->start = start;
+    out->end = end;
+    snprintf(out->permissions, sizeof(out->permissions), "%s", permissions);
+    return 0;
+}
+
+// Map a raw dump file and place it at start
+static int offline_add_file(OfflineImage *image, RegionTable *table,
+                            const char *path, unsigned long start, const char *permissions,
+                            const char *pathname) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    return offline_add(image, table, start, start + st.st_size,
+                       permissions, pathname, data, NULL);
+}
+
+static int offline_add_dir(OfflineImage *image, RegionTable *table,
+                           const char *dir) {
+    char path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/%s", dir, DUMP_INDEX_NAME);
+    FILE *index = fopen(path, "r");
+    if (!index) {
+        perror(path);
+        return -1;
+    }
+    
+    char line[PATH_MAX + 512];
+    int failed = 0;
+    while (!failed && fgets(line, sizeof(line), index)) {
+        char filename[256], perms[8], pathname[256] = "";
+        unsigned long start, end;
+        if (sscanf(line, "%255s %lx-%lx %7s %255[^\n]", filename, &start, &end, perms, pathname) < 4) {
+            continue;
+        }
+        char file_path[PATH_MAX + 512];
+        snprintf(file_path, sizeof(file_path), "%s/%s", dir, filename);
+        failed = offline_add_file(image, table, file_path, start, perms, pathname) != 0;
+    }
+    fclose(index);
+    return failed ? -1 : 0;
+}
+
+static int offline_add_container(OfflineImage *image, RegionTable *table,
+                                 const char *path) {
+    // Regions point into this array, so offline_image_load sizes it for
+    // every source up front and it never moves
+    Container *container = &image->containers[image->container_count];
+    if (container_open(container, path) != 0) return -1;
+    image->container_count++;
+    for (uint32_t r = 0; r < container->header->region_count; r++) {
+        const RegionRecord *rec = &container->regions[r];
+        char pathname[sizeof(rec->pathname) + 1];
+        snprintf(pathname, sizeof(pathname), "%.*s", (int)sizeof(rec->pathname), rec->pathname);
+        char permissions[sizeof(rec->permissions) + 1];
+        snprintf(permissions, sizeof(permissions), "%.*s", (int)sizeof(rec->permissions), rec->permissions);
+        if (offline_add(image, table, rec->start, rec->end, permissions,
+                        pathname, NULL, container) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int offline_region_cmp(const void *a, const void *b) {
+    const OfflineRegion *x = a, *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+static int memory_region_cmp(const void *a, const void *b) {
+    const MemoryRegion *x = a, *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+void offline_image_free(OfflineImage *image) {
+    for (size_t r = 0; r < image->count; r++) {
+        if (image->regions[r].data) {
+            munmap((void *)image->regions[r].data, image->regions[r].end - image->regions[r].start);
+        }
+    }
+    for (size_t c = 0; c < image->container_count; c++) container_close(&image->containers[c]);
+    free(image->regions);
+    free(image->containers);
+    memset(image, 0, sizeof(*image));
+}
+
+static int is_container_file(const char *path) {
+    char magic[8];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    int yes = read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic) &&
+              memcmp(magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) == 0;
+    close(fd);
+    return yes;
+}
+
+// Load every source into image and fill regions to match, in address order
+int offline_image_load(OfflineImage *image, char **sources, int source_count, RegionTable *table) {
+    memset(image, 0, sizeof(*image));
+    region_table_init(table);
+    
+    image->containers = malloc(source_count * sizeof(*image->containers));
+    if (!image->containers) return -1;
+    for (int i = 0; i < source_count; i++) {
+        const char *source = sources[i];
+        struct stat st;
+        int failed;
+        if (is_container_file(source)) {
+            failed = offline_add_container(image, table, source);
+        } else if (stat(source, &st) == 0 && S_ISDIR(st.st_mode)) {
+            failed = offline_add_dir(image, table, source);
+        } else {
+            // FILE@ADDR; without an address the file is placed at 0
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s", source);
+            unsigned long start = 0;
+            char *at = strrchr(path, '@');
+            if (at) {
+                *at = '\0';
+                char *end;
+                start = strtoul(at + 1, &end, 16);
+                if (*end != '\0') {
+                    printf("Invalid load address in %s\n", source);
+                    offline_image_free(image);
+                    return -1;
+                }
+            }
+            // Its permissions are unknown: call it data, so that passes
+            // kept to writable memory (--entropy, --references) see it
+            failed = offline_add_file(image, table, path, start, "rw-p", path);
+        }
+        if (failed) {
+            offline_image_free(image);
+            return -1;
+        }
+    }
+    
+    if (image->count > 0) qsort(image->regions, image->count, sizeof(*image->regions), offline_region_cmp);
+    if (table->count > 0) qsort(table->items, table->count, sizeof(*table->items), memory_region_cmp);
+    for (int i = 0; i < table->count; i++) table->items[i].index = i;
+    for (size_t r = 1; r < image->count; r++) {
+        if (image->regions[r].start < image->regions[r - 1].end) {
+            printf("Dumped regions overlap at %lx\n", image->regions[r].start);
+            offline_image_free(image);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// ---- Capture ----
+// --capture keeps the target stopped only while its memory is copied.
+// Every readable region is copied into a private anonymous mapping of its
+// own (anonymous regions only for their resident pages, so untouched
+// reservations cost nothing locally either), the target is detached, and
+// the copies are then scanned and dumped through READ_BACKEND_OFFLINE as
+// if they were loaded dumps.
+
+#define CAPTURE_WINDOW_SIZE (64 * 1024 * 1024) // Bytes copied per batched read
+
+int capture_regions(MemoryReader *reader, MemoryRegion *const *regions, int count,
+                    OfflineImage *image, size_t *copied) {
+    memset(image, 0, sizeof(*image));
+    *copied = 0;
+    image->regions = malloc((count > 0 ? count : 1) * sizeof(*image->regions));
+    size_t window_pages = CAPTURE_WINDOW_SIZE / page_size;
+    unsigned long long *entries = malloc(window_pages * sizeof(*entries));
+    ReadRequest *reqs = malloc(window_pages * sizeof(*reqs));
+    int failed = !image->regions || !entries || !reqs;
+    image->cap = count;
+    
+    for (int i = 0; i < count && !failed; i++) {
+        const MemoryRegion *region = regions[i];
+        if (region->permissions[0] != 'r') continue;
+        size_t region_size = region->end - region->start;
+        unsigned char *copy = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (copy == MAP_FAILED) {
+            perror("mmap capture");
+            failed = 1;
+            break;
+        }
+        madvise(copy, region_size, MADV_HUGEPAGE); // Fewer faults while copying in
+        OfflineRegion *out = &image->regions[image->count++];
+        out->start = region->start;
+        out->end = region->end;
+        out->data = copy;
+        out->container = NULL;
+        
+        int pagemap_fd = pagemap_open(reader, region);
+        for (size_t offset = 0; offset < region_size; offset += CAPTURE_WINDOW_SIZE) {
+            size_t window = (region_size - offset < CAPTURE_WINDOW_SIZE) ? region_size - offset : CAPTURE_WINDOW_SIZE;
+            if (read_window(reader, pagemap_fd, region->start + offset, window, copy + offset, entries, reqs)) {
+                for (size_t p = 0; p < window / page_size; p++) {
+                    if (pagemap_resident(entries[p])) *copied += page_size;
+                }
+            } else {
+                *copied += window;
+            }
+        }
+        if (pagemap_fd >= 0) close(pagemap_fd);
+    }
+    
+    free(entries);
+    free(reqs);
+    if (failed) {
+        offline_image_free(image);
+        return -1;
+    }
+    qsort(image->regions, image->count, sizeof(*image->regions), offline_region_cmp);
+    return 0;
+}
+
+// ---- Region selection ----
+// Which regions to scan, and in what order. Regions are classified by
+// pathname and permissions; --select picks classes, and with smaps data
+// regions holding fewer than --min-rss resident (or swapped) bytes are
+// dropped, which by default skips regions that were never touched. The
+// rest are ordered by anonymous resident bytes, largest first, with
+// executable file mappings (library text) last, so byte budgets are
+// spent where secrets are most likely to be.
+
+enum {
+    REGION_HEAP  = 1 << 0, // [heap]
+    REGION_STACK = 1 << 1, // [stack], [stack:<tid>]
+    REGION_ANON  = 1 << 2, // Other anonymous mappings
+    REGION_FILE  = 1 << 3, // File-backed data
+    REGION_CODE  = 1 << 4, // File-backed executable text
+    REGION_ALL   = (1 << 5) - 1
+};
+
+typedef struct {
+    unsigned classes;
+    size_t min_rss; // Only applied when smaps was joined
+} SelectPolicy;
+
+unsigned region_class(const MemoryRegion *region) {
+    if (strcmp(region->pathname, "[heap]") == 0) return REGION_HEAP;
+    if (strncmp(region->pathname, "[stack", 6) == 0) return REGION_STACK;
+    if (region_is_anonymous(region)) return REGION_ANON;
+    // Kernel-provided mappings ([vdso], [vvar], ...) count as code
+    if (region->pathname[0] == '[' || region->permissions[2] == 'x') return REGION_CODE;
+    return REGION_FILE;
+}
+
+// Parse a comma-separated list of heap, stack, anon, file, code and all.
+// anon includes heap and stack.
+int parse_select_policy(const char *text, unsigned *classes) {
+    static const struct { const char *name; unsigned classes; } names[] = {
+        { "heap", REGION_HEAP },
+        { "stack", REGION_STACK },
+        { "anon", REGION_HEAP | REGION_STACK | REGION_ANON },
+        { "file", REGION_FILE },
+        { "code", REGION_CODE },
+        { "all", REGION_ALL },
+    };
+    *classes = 0;
+    while (*text) {
+        size_t len = strcspn(text, ",");
+        size_t n;
+        for (n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+            if (strlen(names[n].name) == len && strncmp(text, names[n].name, len) == 0) break;
+        }
+        if (n == sizeof(names) / sizeof(names[0])) return -1;
+        *classes |= names[n].classes;
+        text += len;
+        if (*text == ',') text++;
+    }
+    return *classes ? 0 : -1;
+}
+
+static int region_priority_cmp(const void *a, const void *b) {
+    const MemoryRegion *x = *(MemoryRegion *const *)a;
+    const MemoryRegion *y = *(MemoryRegion *const *)b;
+    int x_code = region_class(x) == REGION_CODE, y_code = region_class(y) == REGION_CODE;
+    if (x_code != y_code) return x_code - y_code;
+    if (x->anonymous != y->anonymous) return x->anonymous > y->anonymous ? -1 : 1;
+    size_t x_res = x->rss + x->swap, y_res = y->rss + y->swap;
+    if (x_res != y_res) return x_res > y_res ? -1 : 1;
+    return x->index - y->index;
+}
+
+// Fill selected with the regions to scan, in scan order; returns the count
+int select_regions(const RegionTable *table, const SelectPolicy *policy, MemoryRegion **selected) {
+    int count = 0;
+    for (int i = 0; i < table->count; i++) {
+        MemoryRegion *region = &table->items[i];
+        if (!(region_class(region) & policy->classes)) continue;
+        if (table->has_smaps && region->rss + region->swap < policy->min_rss) continue;
+        selected[count++] = region;
+    }
+    if (table->has_smaps) qsort(selected, count, sizeof(*selected), region_priority_cmp);
+    return count;
+}
+
+// ---- Fleet scans ----
+// Several processes at once: PIDs given on the command line, processes
+// whose name matches --name, and the members of a --cgroup. Worker threads
+// take one process at a time, attach, scan and detach it, so each target
+// is stopped only for its own scan. Read-only file mappings without private
+// (copy-on-write) pages hold the same bytes in every process that maps the
+// same dev/inode/offset, so they are scanned once per run; the matches are
+// kept relative to the mapping and reused for every other process.
+
+#define FLEET_CACHE_BUCKETS 4096
+
+typedef struct {
+    pid_t *items;
+    int count;
+    int cap;
+} PidList;
+
+void pid_list_init(PidList *list) {
+    memset(list, 0, sizeof(*list));
+}
+
+int pid_list_add(PidList *list, pid_t pid) {
+    if (list->count == list->cap) {
+        int new_cap = list->cap ? list->cap * 2 : 64;
+        pid_t *items = realloc(list->items, new_cap * sizeof(*items));
+        if (!items) return -1;
+        list->items = items;
+        list->cap = new_cap;
+    }
+    list->items[list->count++] = pid;
+    return 0;
+}
+
+static int pid_cmp(const void *a, const void *b) {
+    pid_t x = *(const pid_t *)a, y = *(const pid_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sort, drop duplicates and leave ourselves out
+void pid_list_finish(PidList *list) {
+    qsort(list->items, list->count, sizeof(*list->items), pid_cmp);
+    int count = 0;
+    for (int i = 0; i < list->count; i++) {
+        pid_t pid = list->items[i];
+        if (pid <= 0 || pid == getpid()) continue;
+        if (count > 0 && list->items[count - 1] == pid) continue;
+        list->items[count++] = pid;
+    }
+    list->count = count;
+}
+
+// Read /proc/<pid>/comm without the trailing newline; "" when gone
+static void read_process_name(pid_t pid, char *name, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    name[0] = '\0';
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ssize_t got = read(fd, name, size - 1);
+    close(fd);
+    if (got < 0) got = 0;
+    name[got] = '\0';
+    name[strcspn(name, "\n")] = '\0';
+}
+
+// Whether a comma-separated list holds name (length len)
+static int name_in_list(const char *list, const char *name, size_t len) {
+    while (*list) {
+        size_t item = strcspn(list, ",");
+        if (item == len && strncmp(list, name, len) == 0) return 1;
+        list += item;
+        if (*list == ',') list++;
+    }
+    return 0;
+}
+
+// Add every process whose comm or executable basename is in names
+// (comma-separated). comm is cut to 15 bytes, so longer names match on
+// the executable.
+int pid_list_add_by_name(PidList *list, const char *names) {
+    DIR *proc = opendir("/proc");
+    if (!proc) {
+        perror("/proc");
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(proc)) != NULL) {
+        char *end;
+        long pid = strtol(entry->d_name, &end, 10);
+        if (*end != '\0' || pid <= 0) continue;
+        
+        char name[64];
+        read_process_name(pid, name, sizeof(name));
+        int found = name[0] && name_in_list(names, name, strlen(name));
+        if (!found) {
+            char path[64], exe[PATH_MAX];
+            snprintf(path, sizeof(path), "/proc/%ld/exe", pid);
+            ssize_t len = readlink(path, exe, sizeof(exe) - 1);
+            if (len > 0) {
+                exe[len] = '\0';
+                const char *base = strrchr(exe, '/');
+                base = base ? base + 1 : exe;
+                found = name_in_list(names, base, strlen(base));
+            }
+        }
+        if (found && pid_list_add(list, pid) != 0) {
+            closedir(proc);
+            return -1;
+        }
+    }
+    closedir(proc);
+    return 0;
+}
+
+// Add the processes of a cgroup. Relative paths are taken under
+// /sys/fs/cgroup.
+int pid_list_add_cgroup(PidList *list, const char *cgroup) {
+    char path[PATH_MAX + 32];
+    if (strncmp(cgroup, "/sys/", 5) == 0) {
+        snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+    } else {
+        while (*cgroup == '/') cgroup++;
+        snprintf(path, sizeof(path), "/sys/fs/cgroup/%s%scgroup.procs", cgroup, *cgroup ? "/" : "");
+    }
+    FILE *procs = fopen(path, "r");
+    if (!procs) {
+        perror(path);
+        return -1;
+    }
+    int pid;
+    while (fscanf(procs, "%d", &pid) == 1) {
+        if (pid_list_add(list, pid) != 0) {
+            fclose(procs);
+            return -1;
+        }
+    }
+    fclose(procs);
+    return 0;
+}
+
+enum { FLEET_PENDING, FLEET_DONE, FLEET_FAILED };
+
+typedef struct FleetCacheEntry {
+    struct FleetCacheEntry *next;
+    unsigned int dev_major;
+    unsigned int dev_minor;
+    unsigned long inode;
+    unsigned long offset;
+    size_t size;
+    int state;
+    MatchList matches; // Addresses relative to the mapping start, no region
+} FleetCacheEntry;
+
+typedef struct {
+    pid_t pid;
+    char name[64];
+    int error;           // errno of a failed attach or maps read
+    double stopped_ms;
+    RegionTable regions; // Kept until printing, the matches point into it
+    MatchList matches;
+} FleetProcess;
+
+typedef struct {
+    const ScanJob *job;  // Template; reader and threads are set per process
+    ReadBackend backend;
+    const SelectPolicy *policy;
+    FleetProcess *procs;
+    int proc_count;
+    int next_proc;
+    FleetCacheEntry *buckets[FLEET_CACHE_BUCKETS];
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    size_t bytes_scanned;
+    size_t shared_scanned; // Bytes of shared mappings actually scanned
+    size_t shared_reused;  // Bytes of shared mappings answered from the cache
+    int cache_hits;
+} Fleet;
+
+// A mapping whose bytes are the file's own: read-only, file-backed and,
+// going by smaps, without private copies of any page
+static int region_is_shareable(const RegionTable *table, const MemoryRegion *region) {
+    return table->has_smaps && region->inode != 0 && region->pathname[0] == '/' &&
+           region->permissions[1] != 'w' && region->anonymous == 0 && region->swap == 0;
+}
+
+static size_t fleet_scan_size(const ScanJob *job, const MemoryRegion *region) {
+    size_t size = region->end - region->start;
+    if (job->max_region_bytes && size > job->max_region_bytes) size = job->max_region_bytes;
+    return size;
+}
+
+// Find the cache entry for a mapping or, when there is none yet, add a
+// pending one; *created tells the caller it has to fill it. Called with
+// the fleet lock held.
+static FleetCacheEntry *fleet_cache_get(Fleet *fleet, const MemoryRegion *region, size_t size, int *created) {
+    uint64_t key = ((uint64_t)region->dev_major << 48) ^ ((uint64_t)region->dev_minor << 32) ^
+                   region->inode ^ ((uint64_t)region->offset << 20) ^ size;
+    FleetCacheEntry **bucket = &fleet->buckets[xxh64(&key, sizeof(key), 0) % FLEET_CACHE_BUCKETS];
+    *created = 0;
+    for (FleetCacheEntry *entry = *bucket; entry; entry = entry->next) {
+        if (entry->dev_major == region->dev_major && entry->dev_minor == region->dev_minor &&
+            entry->inode == region->inode && entry->offset == region->offset && entry->size == size) {
+            return entry;
+        }
+    }
+    FleetCacheEntry *entry = calloc(1, sizeof(*entry));
+    if (!entry) return NULL;
+    entry->dev_major = region->dev_major;
+    entry->dev_minor = region->dev_minor;
+    entry->inode = region->inode;
+    entry->offset = region->offset;
+    entry->size = size;
+    entry->state = FLEET_PENDING;
+    match_list_init(&entry->matches);
+    entry->next = *bucket;
+    *bucket = entry;
+    *created = 1;
+    return entry;
+}
+
+// Append the cached matches of a mapping, placed at this process's copy
+static int fleet_cache_apply(const FleetCacheEntry *entry, MemoryRegion *region, MatchList *out) {
+    size_t first = out->count;
+    if (match_list_append(out, &entry->matches) != 0) return -1;
+    for (size_t i = first; i < out->count; i++) {
+        out->items[i].addr += region->start;
+        out->items[i].region = region;
+    }
+    return 0;
+}
+
+// Scan one shared mapping into its cache entry and wake anyone waiting
+static void fleet_cache_fill(Fleet *fleet, ScanJob *job, FleetCacheEntry *entry, MemoryRegion *region) {
+    MatchList found;
+    int failed = scan_regions(job, &region, 1, &found) != 0;
+    for (size_t i = 0; i < found.count; i++) {
+        found.items[i].addr -= region->start;
+        found.items[i].region = NULL;
+    }
+    pthread_mutex_lock(&fleet->lock);
+    if (failed) {
+        match_list_free(&found);
+    } else {
+        entry->matches = found;
+        fleet->shared_scanned += entry->size;
+    }
+    entry->state = failed ? FLEET_FAILED : FLEET_DONE;
+    pthread_cond_broadcast(&fleet->done);
+    pthread_mutex_unlock(&fleet->lock);
+}
+
+// Scan a stopped process into proc->matches
+static void fleet_scan_stopped(Fleet *fleet, FleetProcess *proc, MemoryReader *reader) {
+    if (read_memory_regions(proc->pid, &proc->regions) != 0) {
+        proc->error = errno ? errno : EIO;
+        return;
+    }
+    region_table_join_smaps(proc->pid, &proc->regions);
+    int count = proc->regions.count;
+    MemoryRegion **selected = malloc((count > 0 ? count : 1) * sizeof(*selected));
+    MemoryRegion **waiting = malloc((count > 0 ? count : 1) * sizeof(*waiting));
+    FleetCacheEntry **waiting_for = malloc((count > 0 ? count : 1) * sizeof(*waiting_for));
+    if (!selected || !waiting || !waiting_for) {
+        proc->error = ENOMEM;
+        free(selected);
+        free(waiting);
+        free(waiting_for);
+        return;
+    }
+    count = select_regions(&proc->regions, fleet->policy, selected);
+    memory_reader_open(reader, proc->pid, fleet->backend, proc->regions.items, proc->regions.count);
+    
+    ScanJob job = *fleet->job;
+    job.reader = reader;
+    job.threads = 1; // One process per worker; ptrace needs the attaching thread
+    job.progress = 0;
+    job.quiet = 1;
+    ScanJob shared_job = job; // Shared mappings are not charged to any one process
+    shared_job.max_total_bytes = 0;
+    
+    // Take shared mappings out of the list: answered from the cache, scanned
+    // here and cached, or (when another worker is scanning one) collected
+    // after the rest of the process
+    int private_count = 0, waiting_count = 0;
+    size_t reused = 0;
+    int hits = 0;
+    for (int i = 0; i < count; i++) {
+        MemoryRegion *region = selected[i];
+        if (!region_is_scannable(region) || !region_is_shareable(&proc->regions, region)) {
+            selected[private_count++] = region;
+            continue;
+        }
+        size_t size = fleet_scan_size(&job, region);
+        int created;
+        pthread_mutex_lock(&fleet->lock);
+        FleetCacheEntry *entry = fleet_cache_get(fleet, region, size, &created);
+        int state = entry ? entry->state : FLEET_FAILED;
+        pthread_mutex_unlock(&fleet->lock);
+        
+        if (created) {
+            fleet_cache_fill(fleet, &shared_job, entry, region);
+            state = entry->state; // Final once filled
+        } else if (state == FLEET_PENDING) {
+            waiting[waiting_count] = region;
+            waiting_for[waiting_count++] = entry;
+            continue;
+        } else if (state == FLEET_DONE) {
+            reused += size;
+            hits++;
+        }
+        if (state != FLEET_DONE || fleet_cache_apply(entry, region, &proc->matches) != 0) {
+            selected[private_count++] = region;
+        }
+    }
+    
+    MatchList own;
+    if (scan_regions(&job, selected, private_count, &own) != 0) proc->error = ENOMEM;
+    match_list_append(&proc->matches, &own);
+    match_list_free(&own);
+    size_t scanned = 0, remaining = job.max_total_bytes;
+    for (int i = 0; i < private_count; i++) {
+        if (!region_is_scannable(selected[i])) continue;
+        size_t size = fleet_scan_size(&job, selected[i]);
+        if (job.max_total_bytes) {
+            if (size > remaining) size = remaining;
+            remaining -= size;
+        }
+        scanned += size;
+    }
+    
+    for (int i = 0; i < waiting_count; i++) {
+        pthread_mutex_lock(&fleet->lock);
+        while (waiting_for[i]->state == FLEET_PENDING) pthread_cond_wait(&fleet->done, &fleet->lock);
+        int state = waiting_for[i]->state;
+        pthread_mutex_unlock(&fleet->lock);
+        if (state == FLEET_DONE && fleet_cache_apply(waiting_for[i], waiting[i], &proc->matches) == 0) {
+            reused += waiting_for[i]->size;
+            hits++;
+        } else {
+            // The other scan failed; do this copy ourselves
+            if (scan_regions(&shared_job, &waiting[i], 1, &own) != 0) proc->error = ENOMEM;
+            match_list_append(&proc->matches, &own);
+            match_list_free(&own);
+            scanned += fleet_scan_size(&job, waiting[i]);
+        }
+    }
+    match_list_sort(&proc->matches);
+    free(selected);
+    free(waiting);
+    free(waiting_for);
+    
+    pthread_mutex_lock(&fleet->lock);
+    fleet->bytes_scanned += scanned;
+    fleet->shared_reused += reused;
+    fleet->cache_hits += hits;
+    pthread_mutex_unlock(&fleet->lock);
+}
+
+static void *fleet_worker_run(void *arg) {
+    Fleet *fleet = arg;
+    for (;;) {
+        pthread_mutex_lock(&fleet->lock);
+        int next = fleet->next_proc < fleet->proc_count ? fleet->next_proc++ : -1;
+        pthread_mutex_unlock(&fleet->lock);
+        if (next < 0) break;
+        
+        FleetProcess *proc = &fleet->procs[next];
+        read_process_name(proc->pid, proc->name, sizeof(proc->name));
+        double stop_start = now_seconds();
+        if (ptrace(PTRACE_ATTACH, proc->pid, NULL, NULL) == -1) {
+            proc->error = errno;
+            continue;
+        }
+        int status;
+        waitpid(proc->pid, &status, __WALL);
+        
+        MemoryReader reader;
+        reader.mem_fd = -1;
+        fleet_scan_stopped(fleet, proc, &reader);
+        memory_reader_close(&reader);
+        ptrace(PTRACE_DETACH, proc->pid, NULL, NULL);
+        proc->stopped_ms = (now_seconds() - stop_start) * 1000;
+    }
+    return NULL;
+}
+
+// Scan every process in pids with job's pattern(s) on up to threads
+// workers, then print the matches process by process, in PID order.
+// Returns the number of matches, or -1 when nothing could be scanned.
+long fleet_scan(const ScanJob *job, ReadBackend backend, const SelectPolicy *policy,
+                const PatternSet *set, const PidList *pids, int threads) {
+    Fleet *fleet = calloc(1, sizeof(*fleet));
+    if (!fleet) return -1;
+    fleet->procs = calloc(pids->count > 0 ? pids->count : 1, sizeof(*fleet->procs));
+    if (!fleet->procs) {
+        free(fleet);
+        return -1;
+    }
+    fleet->job = job;
+    fleet->backend = backend;
+    fleet->policy = policy;
+    fleet->proc_count = pids->count;
+    for (int i = 0; i < pids->count; i++) {
+        fleet->procs[i].pid = pids->items[i];
+        region_table_init(&fleet->procs[i].regions);
+        match_list_init(&fleet->procs[i].matches);
+    }
+    pthread_mutex_init(&fleet->lock, NULL);
+    pthread_cond_init(&fleet->done, NULL);
+    
+    if (threads > pids->count) threads = pids->count > 0 ? pids->count : 1;
+    printf("Scanning %d processes with %d thread%s\n", pids->count, threads, threads == 1 ? "" : "s");
+    double started = now_seconds();
+    pthread_t *workers = malloc(threads * sizeof(*workers));
+    int running = 0;
+    for (; workers && running < threads; running++) {
+        if (pthread_create(&workers[running], NULL, fleet_worker_run, fleet) != 0) break;
+    }
+    if (running == 0) fleet_worker_run(fleet);
+    for (int w = 0; w < running; w++) pthread_join(workers[w], NULL);
+    free(workers);
+    double elapsed = now_seconds() - started;
+    
+    // Output and the per-pattern counts, from one list of everything
+    MatchList all;
+    match_list_init(&all);
+    int scanned = 0;
+    for (int i = 0; i < fleet->proc_count; i++) {
+        FleetProcess *proc = &fleet->procs[i];
+        if (proc->error && proc->regions.count == 0) {
+            printf("PID %d (%s): not scanned: %s\n", proc->pid,
+                   proc->name[0] ? proc->name : "?", strerror(proc->error));
+            continue;
+        }
+        scanned++;
+        printf("\nPID %d (%s): %zu match%s, stopped for %.3f ms%s\n", proc->pid, proc->name,
+               proc->matches.count, proc->matches.count == 1 ? "" : "es", proc->stopped_ms,
+               proc->error ? " (incomplete)" : "");
+        for (size_t m = 0; m < proc->matches.count; m++) {
+            const Match *match = &proc->matches.items[m];
+            print_match(&proc->matches, match, set ? set->patterns[match->pattern].label : NULL);
+        }
+        match_list_append(&all, &proc->matches);
+    }
+    if (set) print_pattern_hits(set, &all);
+    long total = (long)all.count;
+    match_list_free(&all);
+    
+    int cached = 0;
+    for (int b = 0; b < FLEET_CACHE_BUCKETS; b++) {
+        while (fleet->buckets[b]) {
+            FleetCacheEntry *entry = fleet->buckets[b];
+            fleet->buckets[b] = entry->next;
+            cached++;
+            match_list_free(&entry->matches);
+            free(entry);
+        }
+    }
+    printf("\nScanned %d of %d processes in %.3f s: %zu bytes scanned, %d shared mappings\n"
+           "scanned once and reused %d times (%zu bytes not rescanned)\n",
+           scanned, fleet->proc_count, elapsed, fleet->bytes_scanned + fleet->shared_scanned,
+           cached, fleet->cache_hits, fleet->shared_reused);
+    
+    for (int i = 0; i < fleet->proc_count; i++) {
+        match_list_free(&fleet->procs[i].matches);
+        region_table_free(&fleet->procs[i].regions);
+    }
+    pthread_mutex_destroy(&fleet->lock);
+    pthread_cond_destroy(&fleet->done);
+    free(fleet->procs);
+    free(fleet);
+    return scanned > 0 ? total : -1;
+}
+
+// ---- Strings extraction ----
+// --strings prints every run of printable ASCII (0x20-0x7e and tab) and
+// every run of such characters in UTF-16LE (each followed by a zero byte)
+// that is at least MIN characters long, with its address and region, like
+// strings(1) over live memory or dumps. Bytes are classified 64 at a time
+// with SIMD into printable and zero bitmasks, and runs are found with bit
+// scans over the masks. A string is printed when it ends, or in
+// STRINGS_FLUSH_CHARS pieces if it is longer, so nothing larger is held.
+// The strings ending in a block are printed together at its end, by
+// address, so the output is the same whatever the chunk size.
+
+#define STRINGS_DEFAULT_MIN 6
+#define STRINGS_FLUSH_CHARS 65536
+
+typedef void (*StringsClassifyFn)(const unsigned char *block, uint64_t *printable, uint64_t *zero);
+
+typedef struct {
+    int utf16;
+    int active;
+    unsigned long start;    // Address of the first byte
+    size_t chars;
+    int printed;            // Header and a first piece already out
+    unsigned char *text;    // Characters not printed yet
+    size_t text_len;
+    size_t text_cap;
+} StringRun;
+
+// A string that ended in the current block
+typedef struct {
+    unsigned long start;
+    int utf16;
+    int printed;
+    size_t text_off;        // Into StringsExtract.done_text
+    size_t text_len;
+} StringOut;
+
+typedef struct {
+    const MemoryRegion *region;
+    size_t min_len;
+    StringsClassifyFn classify;
+    StringRun ascii;
+    StringRun utf16[2];     // Characters ending at even, odd addresses
+    int prev_printable;     // Of the byte just before the next block
+    unsigned char prev_byte;
+    uint64_t carry[2];      // UTF-16 run bits spilling into the next block
+    StringOut *done;
+    size_t done_count;
+    size_t done_cap;
+    unsigned char *done_text;
+    size_t done_text_len;
+    size_t done_text_cap;
+    int failed;
+    size_t count;
+} StringsExtract;
+
+static void strings_classify_scalar(const unsigned char *block, size_t n, uint64_t *printable, uint64_t *zero) {
+    uint64_t p = 0, z = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = block[i];
+        p |= (uint64_t)((c >= 0x20 && c < 0x7f) || c == '\t') << i;
+        z |= (uint64_t)(c == 0) << i;
+    }
+    *printable = p;
+    *zero = z;
+}
+
+static void strings_classify_portable(const unsigned char *block, uint64_t *printable, uint64_t *zero) {
+    strings_classify_scalar(block, 64, printable, zero);
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static void strings_classify_sse2(const unsigned char *block, uint64_t *printable, uint64_t *zero) {
+    const __m128i low = _mm_set1_epi8(0x1f), high = _mm_set1_epi8(0x7f);
+    const __m128i tab = _mm_set1_epi8('\t'), nul = _mm_setzero_si128();
+    uint64_t p = 0, z = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(block + 16 * i));
+        // Signed compares: bytes from 0x80 up are negative and fail the first
+        __m128i print = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(b, low), _mm_cmplt_epi8(b, high)),
+                                     _mm_cmpeq_epi8(b, tab));
+        p |= (uint64_t)(unsigned)_mm_movemask_epi8(print) << (16 * i);
+        z |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(b, nul)) << (16 * i);
+    }
+    *printable = p;
+    *zero = z;
+}
+
+__attribute__((target("avx2")))
+static void strings_classify_avx2(const unsigned char *block, uint64_t *printable, uint64_t *zero) {
+    const __m256i low = _mm256_set1_epi8(0x1f), high = _mm256_set1_epi8(0x7f);
+    const __m256i tab = _mm256_set1_epi8('\t'), nul = _mm256_setzero_si256();
+    uint64_t p = 0, z = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)(block + 32 * i));
+        __m256i print = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi8(b, low),
+                                                         _mm256_cmpgt_epi8(high, b)),
+                                        _mm256_cmpeq_epi8(b, tab));
+        p |= (uint64_t)(unsigned)_mm256_movemask_epi8(print) << (32 * i);
+        z |= (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nul)) << (32 * i);
+    }
+    *printable = p;
+    *zero = z;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void strings_classify_avx512(const unsigned char *block, uint64_t *printable, uint64_t *zero) {
+    __m512i b = _mm512_loadu_si512((const void *)block);
+    *printable = (_mm512_cmpgt_epi8_mask(b, _mm512_set1_epi8(0x1f)) &
+                  _mm512_cmplt_epi8_mask(b, _mm512_set1_epi8(0x7f))) |
+                 _mm512_cmpeq_epi8_mask(b, _mm512_set1_epi8('\t'));
+    *zero = _mm512_testn_epi8_mask(b, b);
+}
+#endif
+
+static StringsClassifyFn select_strings_classifier(void) {
+    #ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) return strings_classify_avx512;
+    if (__builtin_cpu_supports("avx2")) return strings_classify_avx2;
+    if (__builtin_cpu_supports("sse2")) return strings_classify_sse2;
+    #endif
+    return strings_classify_portable;
+}
+
+static void string_header(StringsExtract *ex, unsigned long start, int utf16) {
+    printf("0x%lx %s %s: ", start, utf16 ? "utf16" : "ascii",
+           ex->region->pathname[0] ? ex->region->pathname : "[anonymous]");
+}
+
+static void string_run_flush(StringsExtract *ex, StringRun *run) {
+    if (!run->printed) {
+        string_header(ex, run->start, run->utf16);
+        run->printed = 1;
+    }
+    fwrite(run->text, 1, run->text_len, stdout);
+    run->text_len = 0;
+}
+
+// Add count characters, the first at chars[0] and then every stride bytes.
+// The buffer holds at least min_len, so a full one is always long enough.
+static void string_run_add(StringsExtract *ex, StringRun *run, const unsigned char *chars,
+                           size_t count, size_t stride) {
+    run->chars += count;
+    while (count > 0) {
+        size_t n = run->text_cap - run->text_len;
+        if (n > count) n = count;
+        if (stride == 1) {
+            memcpy(run->text + run->text_len, chars, n);
+        } else {
+            for (size_t i = 0; i < n; i++) run->text[run->text_len + i] = chars[i * stride];
+        }
+        run->text_len += n;
+        chars += n * stride;
+        count -= n;
+        if (run->text_len == run->text_cap) string_run_flush(ex, run);
+    }
+}
+
+// Keep the rest of a finished string for strings_print_done
+static int string_stage(StringsExtract *ex, StringRun *run) {
+    if (ex->done_count == ex->done_cap) {
+        size_t cap = ex->done_cap ? ex->done_cap * 2 : 64;
+        StringOut *done = realloc(ex->done, cap * sizeof(*done));
+        if (!done) return -1;
+        ex->done = done;
+        ex->done_cap = cap;
+    }
+    if (ex->done_text_len + run->text_len > ex->done_text_cap) {
+        size_t cap = ex->done_text_cap ? ex->done_text_cap * 2 : 4096;
+        while (cap < ex->done_text_len + run->text_len) cap *= 2;
+        unsigned char *text = realloc(ex->done_text, cap);
+        if (!text) return -1;
+        ex->done_text = text;
+        ex->done_text_cap = cap;
+    }
+    StringOut *out = &ex->done[ex->done_count++];
+    out->start = run->start;
+    out->utf16 = run->utf16;
+    out->printed = run->printed;
+    out->text_off = ex->done_text_len;
+    out->text_len = run->text_len;
+    memcpy(ex->done_text + ex->done_text_len, run->text, run->text_len);
+    ex->done_text_len += run->text_len;
+    return 0;
+}
+
+// Print the strings that ended in this block. Runs are found a byte or two
+// after they end, and one kind at a time, so they are sorted first.
+static void strings_print_done(StringsExtract *ex) {
+    for (size_t i = 1; i < ex->done_count; i++) {
+        StringOut out = ex->done[i];
+        size_t j = i;
+        while (j > 0 && (ex->done[j - 1].start > out.start ||
+                         (ex->done[j - 1].start == out.start && ex->done[j - 1].utf16 > out.utf16))) {
+            ex->done[j] = ex->done[j - 1];
+            j--;
+        }
+        ex->done[j] = out;
+    }
+    for (size_t i = 0; i < ex->done_count; i++) {
+        const StringOut *out = &ex->done[i];
+        if (!out->printed) string_header(ex, out->start, out->utf16);
+        fwrite(ex->done_text + out->text_off, 1, out->text_len, stdout);
+        putchar('\n');
+    }
+    ex->count += ex->done_count;
+    ex->done_count = 0;
+    ex->done_text_len = 0;
+}
+
+static void string_run_end(StringsExtract *ex, StringRun *run) {
+    if ((run->printed || run->chars >= ex->min_len) && string_stage(ex, run) != 0) {
+        // Out of memory: print it now, out of order if need be
+        ex->failed = 1;
+        string_run_flush(ex, run);
+        putchar('\n');
+        ex->count++;
+    }
+    run->active = 0;
+    run->printed = 0;
+    run->chars = 0;
+    run->text_len = 0;
+}
+
+// Bytes [from, to) of the block at base, data, continue the run. For
+// UTF-16 the run bits are shifted a byte: each character sets the bits of
+// its zero byte and the byte after it, so consecutive characters make one
+// unbroken run of bits, and the characters are the bits of parity q.
+static void strings_piece(StringsExtract *ex, StringRun *run, int q, const unsigned char *data,
+                          unsigned long base, size_t from, size_t to) {
+    if (!run->utf16) {
+        if (!run->active) run->start = base + from;
+        run->active = 1;
+        string_run_add(ex, run, data + from, to - from, 1);
+        return;
+    }
+    size_t first = ((base + from) & 1) == (unsigned long)q ? from : from + 1;
+    if (first >= to) return;
+    if (!run->active) run->start = base + first - 1;
+    run->active = 1;
+    if (first == 0) {
+        // Its printable byte ended the previous block
+        string_run_add(ex, run, &ex->prev_byte, 1, 1);
+        first += 2;
+    }
+    if (first < to) string_run_add(ex, run, data + first - 1, (to - first + 1) / 2, 2);
+}
+
+// Walk the runs of set bits in mask over the n bytes at data
+static void strings_walk(StringsExtract *ex, StringRun *run, int q, uint64_t mask,
+                         const unsigned char *data, unsigned long base, size_t n) {
+    size_t pos = 0;
+    while (pos < n) {
+        uint64_t bits = mask >> pos;
+        if (run->active || (bits & 1)) {
+            uint64_t clear = ~bits;
+            size_t ones = clear ? (size_t)__builtin_ctzll(clear) : 64;
+            if (ones > n - pos) ones = n - pos;
+            if (ones > 0) strings_piece(ex, run, q, data, base, pos, pos + ones);
+            pos += ones;
+            if (pos < n) string_run_end(ex, run);
+        } else {
+            if (bits == 0) break;
+            pos += __builtin_ctzll(bits);
+        }
+    }
+}
+
+static void strings_feed(const unsigned char *data, size_t len, unsigned long addr, void *ctx) {
+    StringsExtract *ex = ctx;
+    for (size_t off = 0; off < len; off += 64) {
+        size_t n = (len - off < 64) ? len - off : 64;
+        uint64_t valid = (n == 64) ? ~0ULL : (1ULL << n) - 1;
+        unsigned long base = addr + off;
+        uint64_t printable, zero;
+        if (n == 64) {
+            ex->classify(data + off, &printable, &zero);
+        } else {
+            strings_classify_scalar(data + off, n, &printable, &zero);
+        }
+
+        strings_walk(ex, &ex->ascii, 0, printable, data + off, base, n);
+
+        // UTF-16LE characters, marked at their zero byte
+        uint64_t ends = zero & ((printable << 1) | (uint64_t)ex->prev_printable) & valid;
+        uint64_t even = (base & 1) ? 0xaaaaaaaaaaaaaaaaULL : 0x5555555555555555ULL;
+        for (int q = 0; q < 2; q++) {
+            uint64_t mine = ends & (q ? ~even : even);
+            uint64_t run_bits = (mine | (mine << 1) | ex->carry[q]) & valid;
+            ex->carry[q] = (mine >> (n - 1)) & 1;
+            strings_walk(ex, &ex->utf16[q], q, run_bits, data + off, base, n);
+        }
+        ex->prev_printable = (printable >> (n - 1)) & 1;
+        ex->prev_byte = data[off + n - 1];
+        if (ex->done_count > 0) strings_print_done(ex);
+    }
+}
+
+// Print the strings in the given regions, each read in chunk_size pieces.
+// Budgets work as for scans. Returns the number of strings, -1 on
+// allocation failure.
+long extract_strings(MemoryReader *reader, MemoryRegion *const *regions, int count, size_t min_len,
+                     size_t chunk_size, size_t max_region_bytes, size_t max_total_bytes) {
+    StringsExtract ex;
+    memset(&ex, 0, sizeof(ex));
+    ex.min_len = min_len;
+    ex.classify = select_strings_classifier();
+    StringRun *runs[3] = { &ex.ascii, &ex.utf16[0], &ex.utf16[1] };
+    int failed = 0;
+    for (int k = 0; k < 3; k++) {
+        runs[k]->utf16 = (k > 0);
+        runs[k]->text_cap = (min_len > STRINGS_FLUSH_CHARS) ? min_len : STRINGS_FLUSH_CHARS;
+        runs[k]->text = malloc(runs[k]->text_cap);
+        if (!runs[k]->text) failed = 1;
+    }
+    ReadBuffer buffer;
+    if (!failed && read_buffer_init(&buffer, chunk_size) != 0) failed = 1;
+
+    size_t remaining = max_total_bytes;
+    for (int i = 0; i < count && !failed; i++) {
+        MemoryRegion *region = regions[i];
+        if (!region_is_scannable(region)) continue;
+        size_t size = region->end - region->start;
+        if (max_region_bytes && size > max_region_bytes) size = max_region_bytes;
+        if (max_total_bytes) {
+            if (size > remaining) size = remaining;
+            remaining -= size;
+        }
+        if (size == 0) continue;
+
+        ex.region = region;
+        ex.prev_printable = 0;
+        ex.carry[0] = ex.carry[1] = 0;
+        read_range_chunks(reader, &buffer, region->start, region->start + size, strings_feed, &ex);
+        for (int k = 0; k < 3; k++) string_run_end(&ex, runs[k]);
+        strings_print_done(&ex);
+    }
+
+    if (!failed) read_buffer_free(&buffer);
+    for (int k = 0; k < 3; k++) free(runs[k]->text);
+    free(ex.done);
+    free(ex.done_text);
+    if (ex.failed) failed = 1;
+    return failed ? -1 : (long)ex.count;
+}
+
+// ---- Candidate sets ----
+// A scan can save where it matched (--candidates=FILE) so that later runs
+// look only at those addresses (--narrow=FILE) and keep the ones that
+// pass a test: changed, unchanged, increased or decreased since the value
+// saved with each candidate, or matching a --value query. Candidates are
+// grouped into CANDIDATE_WINDOW windows. A window holds sorted 32-bit
+// offsets, or a bitmap with one bit per stride when that is smaller, plus
+// the candidates' values in address order. A narrowing pass reads only
+// the pages holding candidates, one batched read per window. Layout:
+//
+//   CandidateHeader
+//   per window: CandidateWindowRecord, offsets or bitmap, values
+
+#define CANDIDATE_MAGIC "MDCAND1"
+#define CANDIDATE_WINDOW (1024 * 1024)
+#define NARROW_PRINT_MAX 100 // List the survivors when there are this few
+
+typedef enum {
+    KEEP_CHANGED,
+    KEEP_UNCHANGED,
+    KEEP_INCREASED,
+    KEEP_DECREASED,
+    KEEP_VALUE
+} NarrowTest;
+
+typedef struct {
+    unsigned long start;    // A multiple of CANDIDATE_WINDOW
+    size_t count;
+    int dense;
+    uint32_t *offsets;      // Sparse: sorted, from start
+    uint64_t *bitmap;       // Dense: bit per stride slot
+    unsigned char *values;  // width bytes per candidate, in address order
+} CandidateWindow;
+
+typedef struct {
+    char type[8];           // Value type name, or "bytes"
+    size_t width;
+    size_t stride;          // Candidates sit at multiples of stride
+    CandidateWindow *windows;
+    size_t count;
+    size_t cap;
+    size_t offsets_cap;     // Of the last window while it is being filled
+    size_t total;
+} CandidateSet;
+
+typedef struct {
+    char magic[8];
+    char type[8];
+    uint32_t width;
+    uint32_t stride;
+    uint64_t window_count;
+    uint64_t total;
+} CandidateHeader;
+
+typedef struct {
+    uint64_t start;
+    uint32_t count;
+    uint32_t dense;
+} CandidateWindowRecord;
+
+static size_t candidate_bitmap_words(const CandidateSet *set) {
+    return (CANDIDATE_WINDOW / set->stride + 63) / 64;
+}
+
+void candidate_set_init(CandidateSet *set, const char *type, size_t width, size_t stride) {
+    memset(set, 0, sizeof(*set));
+    snprintf(set->type, sizeof(set->type), "%s", type);
+    set->width = width;
+    set->stride = stride;
+}
+
+void candidate_set_free(CandidateSet *set) {
+    for (size_t i = 0; i < set->count; i++) {
+        free(set->windows[i].offsets);
+        free(set->windows[i].bitmap);
+        free(set->windows[i].values);
+    }
+    free(set->windows);
+    set->windows = NULL;
+    set->count = set->cap = set->total = 0;
+}
+
+// Switch the last window to a bitmap if that is smaller
+static int candidate_window_close(CandidateSet *set) {
+    if (set->count == 0) return 0;
+    CandidateWindow *window = &set->windows[set->count - 1];
+    size_t words = candidate_bitmap_words(set);
+    if (window->dense || window->count * sizeof(uint32_t) <= words * sizeof(uint64_t)) return 0;
+
+    window->bitmap = calloc(words, sizeof(uint64_t));
+    if (!window->bitmap) return -1;
+    for (size_t i = 0; i < window->count; i++) {
+        size_t slot = window->offsets[i] / set->stride;
+        window->bitmap[slot / 64] |= 1ULL << (slot % 64);
+    }
+    free(window->offsets);
+    window->offsets = NULL;
+    window->dense = 1;
+    return 0;
+}
+
+// Add a candidate; addresses must come in increasing order
+int candidate_set_add(CandidateSet *set, unsigned long addr, const unsigned char *value) {
+    unsigned long start = addr - addr % CANDIDATE_WINDOW;
+    if (set->count == 0 || set->windows[set->count - 1].start != start) {
+        if (candidate_window_close(set) != 0) return -1;
+        if (set->count == set->cap) {
+            size_t cap = set->cap ? set->cap * 2 : 64;
+            CandidateWindow *windows = realloc(set->windows, cap * sizeof(*windows));
+            if (!windows) return -1;
+            set->windows = windows;
+            set->cap = cap;
+        }
+        memset(&set->windows[set->count], 0, sizeof(CandidateWindow));
+        set->windows[set->count++].start = start;
+        set->offsets_cap = 0;
+    }
+
+    CandidateWindow *window = &set->windows[set->count - 1];
+    if (window->count == set->offsets_cap) {
+        size_t cap = set->offsets_cap ? set->offsets_cap * 2 : 16;
+        uint32_t *offsets = realloc(window->offsets, cap * sizeof(*offsets));
+        unsigned char *values = realloc(window->values, cap * set->width);
+        if (offsets) window->offsets = offsets;
+        if (values) window->values = values;
+        if (!offsets || !values) return -1;
+        set->offsets_cap = cap;
+    }
+    window->offsets[window->count] = (uint32_t)(addr - start);
+    memcpy(window->values + window->count * set->width, value, set->width);
+    window->count++;
+    set->total++;
+    return 0;
+}
+
+int candidate_set_finish(CandidateSet *set) {
+    return candidate_window_close(set);
+}
+
+// The window's candidate offsets, in order, into offsets
+static void candidate_window_offsets(const CandidateSet *set, const CandidateWindow *window,
+                                     uint32_t *offsets) {
+    if (!window->dense) {
+        memcpy(offsets, window->offsets, window->count * sizeof(*offsets));
+        return;
+    }
+    size_t n = 0;
+    size_t words = candidate_bitmap_words(set);
+    for (size_t w = 0; w < words; w++) {
+        for (uint64_t bits = window->bitmap[w]; bits; bits &= bits - 1) {
+            offsets[n++] = (uint32_t)((w * 64 + __builtin_ctzll(bits)) * set->stride);
+        }
+    }
+}
+
+// The matches of a single pattern or value scan, sorted by address
+int candidate_set_from_matches(CandidateSet *set, const MatchList *matches) {
+    for (size_t i = 0; i < matches->count; i++) {
+        const Match *match = &matches->items[i];
+        const unsigned char *bytes = matches->bytes + match->context_off + match->context_before;
+        if (candidate_set_add(set, match->addr, bytes) != 0) return -1;
+    }
+    return candidate_set_finish(set);
+}
+
+int candidate_set_save(const CandidateSet *set, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror("create candidate file");
+        return -1;
+    }
+    CandidateHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CANDIDATE_MAGIC, sizeof(CANDIDATE_MAGIC));
+    memcpy(header.type, set->type, sizeof(header.type));
+    header.width = set->width;
+    header.stride = set->stride;
+    header.window_count = set->count;
+    header.total = set->total;
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+
+    size_t words = candidate_bitmap_words(set);
+    for (size_t i = 0; i < set->count && !failed; i++) {
+        const CandidateWindow *window = &set->windows[i];
+        CandidateWindowRecord rec = { window->start, (uint32_t)window->count, (uint32_t)window->dense };
+        failed = fwrite(&rec, sizeof(rec), 1, file) != 1 ||
+                 (window->dense ? fwrite(window->bitmap, sizeof(uint64_t), words, file) != words
+                                : fwrite(window->offsets, sizeof(uint32_t), window->count, file) != window->count) ||
+                 fwrite(window->values, set->width, window->count, file) != window->count;
+    }
+    if (fclose(file) != 0) failed = 1;
+    if (failed) {
+        printf("Could not write candidates to %s\n", path);
+        unlink(path);
+        return -1;
+    }
+    printf("Saved %zu candidates in %zu windows to %s\n", set->total, set->count, path);
+    return 0;
+}
+
+int candidate_set_load(CandidateSet *set, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror("open candidate file");
+        return -1;
+    }
+    CandidateHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, CANDIDATE_MAGIC, sizeof(CANDIDATE_MAGIC)) != 0 ||
+        header.width == 0 || header.width > 4096 || header.stride == 0 ||
+        header.stride > CANDIDATE_WINDOW) {
+        printf("%s: not a candidate file\n", path);
+        fclose(file);
+        return -1;
+    }
+    header.type[sizeof(header.type) - 1] = '\0';
+    candidate_set_init(set, header.type, header.width, header.stride);
+
+    size_t words = candidate_bitmap_words(set);
+    int failed = 0;
+    for (uint64_t i = 0; i < header.window_count && !failed; i++) {
+        CandidateWindowRecord rec;
+        if (fread(&rec, sizeof(rec), 1, file) != 1 || rec.start % CANDIDATE_WINDOW != 0 ||
+            rec.count == 0 || rec.count > CANDIDATE_WINDOW) {
+            failed = 1;
+            break;
+        }
+        if (set->count == set->cap) {
+            size_t cap = set->cap ? set->cap * 2 : 64;
+            CandidateWindow *windows = realloc(set->windows, cap * sizeof(*windows));
+            if (!windows) {
+                failed = 1;
+                break;
+            }
+            set->windows = windows;
+            set->cap = cap;
+        }
+        CandidateWindow *window = &set->windows[set->count++];
+        memset(window, 0, sizeof(*window));
+        window->start = rec.start;
+        window->count = rec.count;
+        window->dense = rec.dense != 0;
+        window->values = malloc(window->count * set->width);
+        if (window->dense) {
+            window->bitmap = malloc(words * sizeof(uint64_t));
+            failed = !window->bitmap || fread(window->bitmap, sizeof(uint64_t), words, file) != words;
+        } else {
+            window->offsets = malloc(window->count * sizeof(uint32_t));
+            failed = !window->offsets ||
+                     fread(window->offsets, sizeof(uint32_t), window->count, file) != window->count;
+        }
+        failed = failed || !window->values ||
+                 fread(window->values, set->width, window->count, file) != window->count;
+        set->total += window->count;
+    }
+    fclose(file);
+    if (failed) {
+        printf("%s: truncated or damaged candidate file\n", path);
+        candidate_set_free(set);
+        return -1;
+    }
+    return 0;
+}
+
+// The region holding [addr, addr + len), or NULL. The table is in address order.
+MemoryRegion *region_lookup(const RegionTable *table, unsigned long addr, size_t len) {
+    int lo = 0, hi = table->count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        MemoryRegion *region = &table->items[mid];
+        if (addr < region->start) {
+            hi = mid - 1;
+        } else if (addr >= region->end) {
+            lo = mid + 1;
+        } else {
+            return (addr + len <= region->end) ? region : NULL;
+        }
+    }
+    return NULL;
+}
+
+// Compare two values of a numeric type: -1, 0 or 1; 0 also when unordered
+static int value_compare(const unsigned char *a, const unsigned char *b, ValueKind kind, size_t width) {
+    if (kind == VALUE_FLOAT) {
+        double x, y;
+        if (width == 4) {
+            float fx, fy;
+            memcpy(&fx, a, 4);
+            memcpy(&fy, b, 4);
+            x = fx;
+            y = fy;
+        } else {
+            memcpy(&x, a, 8);
+            memcpy(&y, b, 8);
+        }
+        return (x < y) ? -1 : (x > y) ? 1 : 0;
+    }
+    uint64_t x = 0, y = 0;
+    memcpy(&x, a, width);
+    memcpy(&y, b, width);
+    if (kind == VALUE_INT && width < 8) {
+        // Sign-extend so the signed comparison below works at every width
+        uint64_t sign = 1ULL << (8 * width - 1);
+        x = (x ^ sign) - sign;
+        y = (y ^ sign) - sign;
+    }
+    if (kind == VALUE_INT) return ((int64_t)x < (int64_t)y) ? -1 : ((int64_t)x > (int64_t)y) ? 1 : 0;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+void print_candidate_value(const unsigned char *p, const CandidateSet *set) {
+    int t = value_type_find(set->type, strlen(set->type));
+    if (t < 0) {
+        for (size_t i = 0; i < set->width; i++) printf("%02x%s", p[i], i + 1 < set->width ? " " : "");
+        return;
+    }
+    if (value_types[t].kind == VALUE_FLOAT) {
+        double v;
+        if (set->width == 4) {
+            float f;
+            memcpy(&f, p, 4);
+            v = f;
+        } else {
+            memcpy(&v, p, 8);
+        }
+        printf("%g", v);
+        return;
+    }
+    uint64_t v = 0;
+    memcpy(&v, p, set->width);
+    if (value_types[t].kind == VALUE_INT && set->width < 8) {
+        uint64_t sign = 1ULL << (8 * set->width - 1);
+        v = (v ^ sign) - sign;
+    }
+    if (value_types[t].kind == VALUE_INT) printf("%lld", (long long)v);
+    else printf("%llu", (unsigned long long)v);
+}
+
+// Reread every candidate and keep those that pass the test, with their new
+// values. Candidates whose region went away are dropped. The survivors
+// replace the set. Returns -1 on allocation failure, leaving it unchanged.
+int narrow_candidates(MemoryReader *reader, const RegionTable *regions, CandidateSet *set,
+                      NarrowTest test, const ValueQuery *value) {
+    int t = value_type_find(set->type, strlen(set->type));
+    ValueKind kind = (t >= 0) ? value_types[t].kind : VALUE_UINT;
+    size_t max_pages = CANDIDATE_WINDOW / PAGE_SIZE_BYTES + 1 + set->width / PAGE_SIZE_BYTES + 1;
+    unsigned char *window_buf = alloc_read_buffer((max_pages + 1) * PAGE_SIZE_BYTES);
+    ReadRequest *reqs = malloc(max_pages * sizeof(*reqs));
+    uint32_t *offsets = malloc((CANDIDATE_WINDOW / set->stride + 1) * sizeof(*offsets));
+    CandidateSet kept;
+    candidate_set_init(&kept, set->type, set->width, set->stride);
+    int failed = !window_buf || !reqs || !offsets;
+
+    double started = now_seconds();
+    size_t bytes_read = 0, windows_read = 0;
+    for (size_t w = 0; w < set->count && !failed; w++) {
+        const CandidateWindow *window = &set->windows[w];
+        candidate_window_offsets(set, window, offsets);
+
+        // One request per run of pages that hold candidates. The buffer
+        // starts at the window's first page.
+        unsigned long base = window->start;
+        size_t nreqs = 0;
+        for (size_t i = 0; i < window->count; i++) {
+            unsigned long first = (base + offsets[i]) / PAGE_SIZE_BYTES * PAGE_SIZE_BYTES;
+            unsigned long last = (base + offsets[i] + set->width - 1) / PAGE_SIZE_BYTES * PAGE_SIZE_BYTES;
+            if (nreqs > 0 && reqs[nreqs - 1].addr + reqs[nreqs - 1].len >= first) {
+                unsigned long end = reqs[nreqs - 1].addr + reqs[nreqs - 1].len;
+                if (last + PAGE_SIZE_BYTES > end) reqs[nreqs - 1].len += last + PAGE_SIZE_BYTES - end;
+                continue;
+            }
+            reqs[nreqs].addr = first;
+            reqs[nreqs].buf = window_buf + (first - base);
+            reqs[nreqs].len = last + PAGE_SIZE_BYTES - first;
+            nreqs++;
+        }
+        read_process_memory_batch(reader, reqs, nreqs);
+        for (size_t r = 0; r < nreqs; r++) bytes_read += reqs[r].len;
+        windows_read++;
+
+        for (size_t i = 0; i < window->count && !failed; i++) {
+            unsigned long addr = base + offsets[i];
+            MemoryRegion *region = region_lookup(regions, addr, set->width);
+            if (!region || !region_is_scannable(region)) continue;
+            const unsigned char *now = window_buf + offsets[i];
+            const unsigned char *before = window->values + i * set->width;
+            int pass;
+            switch (test) {
+            case KEEP_CHANGED:   pass = memcmp(now, before, set->width) != 0; break;
+            case KEEP_UNCHANGED: pass = memcmp(now, before, set->width) == 0; break;
+            case KEEP_INCREASED: pass = value_compare(now, before, kind, set->width) > 0; break;
+            case KEEP_DECREASED: pass = value_compare(now, before, kind, set->width) < 0; break;
+            default:             pass = value_matches(now, value); break;
+            }
+            if (pass && candidate_set_add(&kept, addr, now) != 0) failed = 1;
+        }
+    }
+    if (!failed) failed = candidate_set_finish(&kept) != 0;
+
+    free(window_buf);
+    free(reqs);
+    free(offsets);
+    if (failed) {
+        candidate_set_free(&kept);
+        return -1;
+    }
+    printf("Narrowed %zu candidates to %zu (read %zu kB in %zu windows, %.1f ms)\n",
+           set->total, kept.total, bytes_read / 1024, windows_read, (now_seconds() - started) * 1000);
+    candidate_set_free(set);
+    *set = kept;
+    return 0;
+}
+
+// List the candidates with their current values
+void print_candidates(const CandidateSet *set, const RegionTable *regions) {
+    uint32_t *offsets = malloc((CANDIDATE_WINDOW / set->stride + 1) * sizeof(*offsets));
+    if (!offsets) return;
+    for (size_t w = 0; w < set->count; w++) {
+        const CandidateWindow *window = &set->windows[w];
+        candidate_window_offsets(set, window, offsets);
+        for (size_t i = 0; i < window->count; i++) {
+            unsigned long addr = window->start + offsets[i];
+            const MemoryRegion *region = region_lookup(regions, addr, set->width);
+            printf("0x%lx %s: ", addr, region && region->pathname[0] ? region->pathname : "[anonymous]");
+            print_candidate_value(window->values + i * set->width, set);
+            printf("\n");
+        }
+    }
+    free(offsets);
+}
+
+// ---- Pointer scan ----
+// --references answers "what points at X". One pass over the selected
+// regions treats every aligned word as a candidate pointer and keeps it
+// when its value falls inside a readable, writable region of the table,
+// the only place secrets and the objects holding them live. Each hit
+// becomes a (target, source) pair. The pairs are radix-sorted by target
+// into a reverse index, so a query is a binary search. A word references
+// X when it points at most REFERENCE_WINDOW bytes below X, i.e. at the
+// start of an object X sits in; queries follow referrers up to --depth
+// levels, skipping words already shown.
+
+#define REFERENCE_WINDOW_DEFAULT 256
+#define REFERENCE_MAX_FANOUT 16 // Referrers shown per address
+#define REFERENCE_MAX_ROOTS 16
+#define REFERENCE_DEPTH_DEFAULT 3
+
+typedef struct {
+    uint64_t target;
+    uint64_t source;
+} Reference;
+
+typedef struct {
+    Reference *items;
+    size_t count;
+    size_t cap;
+} ReferenceList;
+
+// The regions pointers may point into, in address order
+typedef struct {
+    unsigned long *starts;
+    unsigned long *ends;
+    int count;
+    int last;             // Region of the previous hit, tried first
+} PointerTargets;
+
+typedef struct {
+    MemoryReader *reader;
+    const PointerTargets *targets;
+    ScanSlice *slices;
+    size_t slice_count;
+    size_t next_slice;
+    size_t chunk_size;
+    pthread_mutex_t lock;
+} PointerScan;
+
+typedef struct {
+    PointerScan *scan;
+    PointerTargets targets; // A copy, for its own last-hit cache
+    ReadBuffer buffer;
+    ReferenceList refs;
+    int failed;
+    pthread_t thread;
+} PointerWorker;
+
+static inline int pointer_target(PointerTargets *targets, unsigned long value) {
+    if (targets->count == 0 || value < targets->starts[0] || value >= targets->ends[targets->count - 1]) {
+        return 0;
+    }
+    int last = targets->last;
+    if (value >= targets->starts[last] && value < targets->ends[last]) return 1;
+
+    int lo = 0, hi = targets->count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (value < targets->starts[mid]) {
+            hi = mid - 1;
+        } else if (value >= targets->ends[mid]) {
+            lo = mid + 1;
+        } else {
+            targets->last = mid;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int reference_list_add(ReferenceList *list, unsigned long target, unsigned long source) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 4096;
+        Reference *items = realloc(list->items, cap * sizeof(*items));
+        if (!items) return -1;
+        list->items = items;
+        list->cap = cap;
+    }
+    list->items[list->count].target = target;
+    list->items[list->count].source = source;
+    list->count++;
+    return 0;
+}
+
+// Chunks start at multiples of the chunk size, itself a multiple of the word size
+static void pointer_scan_chunk(const unsigned char *data, size_t len, unsigned long addr, void *ctx) {
+    PointerWorker *worker = ctx;
+    size_t words = len / sizeof(unsigned long);
+    for (size_t i = 0; i < words && !worker->failed; i++) {
+        unsigned long value;
+        memcpy(&value, data + i * sizeof(value), sizeof(value));
+        if (!pointer_target(&worker->targets, value)) continue;
+        if (reference_list_add(&worker->refs, value, addr + i * sizeof(value)) != 0) worker->failed = 1;
+    }
+}
+
+static void *pointer_worker_run(void *arg) {
+    PointerWorker *worker = arg;
+    PointerScan *scan = worker->scan;
+    for (;;) {
+        pthread_mutex_lock(&scan->lock);
+        size_t s = scan->next_slice++;
+        pthread_mutex_unlock(&scan->lock);
+        if (s >= scan->slice_count || worker->failed) break;
+        read_range_chunks(scan->reader, &worker->buffer, scan->slices[s].start, scan->slices[s].end,
+                          pointer_scan_chunk, worker);
+    }
+    return NULL;
+}
+
+// Sort by target, 16 bits at a time, least significant first
+static int reference_list_sort(ReferenceList *list) {
+    if (list->count < 2) return 0;
+    uint64_t max = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->items[i].target > max) max = list->items[i].target;
+    }
+    Reference *tmp = malloc(list->count * sizeof(*tmp));
+    size_t *counts = malloc(65536 * sizeof(*counts));
+    if (!tmp || !counts) {
+        free(tmp);
+        free(counts);
+        return -1;
+    }
+    for (int shift = 0; shift < 64 && (max >> shift) != 0; shift += 16) {
+        memset(counts, 0, 65536 * sizeof(*counts));
+        for (size_t i = 0; i < list->count; i++) counts[(list->items[i].target >> shift) & 0xffff]++;
+        size_t sum = 0;
+        for (size_t d = 0; d < 65536; d++) {
+            size_t c = counts[d];
+            counts[d] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < list->count; i++) {
+            tmp[counts[(list->items[i].target >> shift) & 0xffff]++] = list->items[i];
+        }
+        Reference *swap = list->items;
+        list->items = tmp;
+        tmp = swap;
+    }
+    free(tmp);
+    free(counts);
+    return 0;
+}
+
+// Build the reverse index of every pointer held in the given regions
+int build_reference_index(MemoryReader *reader, const RegionTable *table, MemoryRegion *const *regions,
+                          int count, size_t chunk_size, int threads, ReferenceList *index) {
+    memset(index, 0, sizeof(*index));
+    PointerTargets targets;
+    memset(&targets, 0, sizeof(targets));
+    targets.starts = malloc((table->count > 0 ? table->count : 1) * sizeof(unsigned long));
+    targets.ends = malloc((table->count > 0 ? table->count : 1) * sizeof(unsigned long));
+    size_t slice_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (!region_is_scannable(regions[i])) continue;
+        slice_count += (regions[i]->end - regions[i]->start + SCAN_SLICE_SIZE - 1) / SCAN_SLICE_SIZE;
+    }
+    ScanSlice *slices = malloc((slice_count ? slice_count : 1) * sizeof(*slices));
+    if (threads < 1 || reader->backend == READ_BACKEND_PTRACE) threads = 1;
+    if ((size_t)threads > slice_count) threads = slice_count ? (int)slice_count : 1;
+    PointerWorker *workers = calloc(threads, sizeof(*workers));
+    if (!targets.starts || !targets.ends || !slices || !workers) {
+        free(targets.starts);
+        free(targets.ends);
+        free(slices);
+        free(workers);
+        return -1;
+    }
+
+    // Adjacent writable regions merge into one target interval
+    for (int i = 0; i < table->count; i++) {
+        const MemoryRegion *region = &table->items[i];
+        if (region->permissions[0] != 'r' || region->permissions[1] != 'w') continue;
+        if (targets.count > 0 && targets.ends[targets.count - 1] == region->start) {
+            targets.ends[targets.count - 1] = region->end;
+        } else {
+            targets.starts[targets.count] = region->start;
+            targets.ends[targets.count++] = region->end;
+        }
+    }
+    size_t n = 0;
+    for (int i = 0; i < count; i++) {
+        MemoryRegion *region = regions[i];
+        if (!region_is_scannable(region)) continue;
+        for (unsigned long start = region->start; start < region->end; start += SCAN_SLICE_SIZE) {
+            slices[n].region = region;
+            slices[n].start = start;
+            slices[n].end = (region->end - start > SCAN_SLICE_SIZE) ? start + SCAN_SLICE_SIZE : region->end;
+            n++;
+        }
+    }
+
+    PointerScan scan = { reader, &targets, slices, slice_count, 0,
+                         (chunk_size + sizeof(unsigned long) - 1) / sizeof(unsigned long) * sizeof(unsigned long),
+                         PTHREAD_MUTEX_INITIALIZER };
+    int failed = 0, started = 0;
+    for (int w = 0; w < threads; w++) {
+        workers[w].scan = &scan;
+        workers[w].targets = targets;
+        if (read_buffer_init(&workers[w].buffer, scan.chunk_size) != 0) failed = 1;
+    }
+    int refused = 0;
+    if (!failed) {
+        // One thread works in place: ptrace reads need the attaching thread
+        reader->shared = threads > 1;
+        for (; threads > 1 && started < threads; started++) {
+            if (pthread_create(&workers[started].thread, NULL, pointer_worker_run, &workers[started]) != 0) break;
+        }
+        if (started == 0) pointer_worker_run(&workers[0]);
+        for (int w = 0; w < started; w++) pthread_join(workers[w].thread, NULL);
+        refused = memory_reader_unshare(reader) != 0;
+    }
+
+    size_t total = 0;
+    for (int w = 0; w < threads; w++) {
+        total += workers[w].refs.count;
+        if (workers[w].failed) failed = 1;
+    }
+    if (!failed && !refused) {
+        index->items = malloc((total ? total : 1) * sizeof(Reference));
+        if (!index->items) failed = 1;
+    }
+    for (int w = 0; w < threads; w++) {
+        if (!failed && !refused && workers[w].refs.count) {
+            memcpy(index->items + index->count, workers[w].refs.items, workers[w].refs.count * sizeof(Reference));
+            index->count += workers[w].refs.count;
+        }
+        free(workers[w].refs.items);
+        read_buffer_free(&workers[w].buffer);
+    }
+    index->cap = index->count;
+    free(workers);
+    free(slices);
+    free(targets.starts);
+    free(targets.ends);
+    pthread_mutex_destroy(&scan.lock);
+    // The reader is on ptrace now, which only this thread may use
+    if (!failed && refused) return build_reference_index(reader, table, regions, count, chunk_size, 1, index);
+    if (failed || reference_list_sort(index) != 0) {
+        free(index->items);
+        memset(index, 0, sizeof(*index));
+        return -1;
+    }
+    return 0;
+}
+
+// First entry with target >= addr
+static size_t reference_lower_bound(const ReferenceList *index, uint64_t addr) {
+    size_t lo = 0, hi = index->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->items[mid].target < addr) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Addresses already shown, so cycles and shared referrers print once
+typedef struct {
+    unsigned long *items;
+    size_t count;
+    size_t cap;
+} AddressSet;
+
+static int address_set_insert(AddressSet *set, unsigned long addr) {
+    if (2 * (set->count + 1) > set->cap) {
+        size_t cap = set->cap ? set->cap * 2 : 256;
+        unsigned long *items = calloc(cap, sizeof(*items));
+        if (!items) return -1;
+        for (size_t i = 0; i < set->cap; i++) {
+            if (!set->items[i]) continue;
+            size_t h = (size_t)xxh64(&set->items[i], sizeof(unsigned long), 0) & (cap - 1);
+            while (items[h]) h = (h + 1) & (cap - 1);
+            items[h] = set->items[i];
+        }
+        free(set->items);
+        set->items = items;
+        set->cap = cap;
+    }
+    size_t h = (size_t)xxh64(&addr, sizeof(addr), 0) & (set->cap - 1);
+    while (set->items[h]) {
+        if (set->items[h] == addr) return 0;
+        h = (h + 1) & (set->cap - 1);
+    }
+    set->items[h] = addr;
+    set->count++;
+    return 1;
+}
+
+typedef struct {
+    const ReferenceList *index;
+    const RegionTable *regions;
+    size_t window;
+    int depth;
+    AddressSet seen;
+} ReferenceQuery;
+
+static int reference_cmp(const void *a, const void *b) {
+    const Reference *x = a, *y = b;
+    if (x->target != y->target) return (x->target > y->target) ? -1 : 1; // Closest first
+    return (x->source > y->source) - (x->source < y->source);
+}
+
+// Print the referrers of addr and, depth permitting, theirs. Returns how many there are.
+static size_t print_referrers(ReferenceQuery *query, unsigned long addr, int level) {
+    uint64_t low = (addr >= query->window - 1) ? addr - (query->window - 1) : 0;
+    size_t first = reference_lower_bound(query->index, low);
+    size_t last = reference_lower_bound(query->index, (uint64_t)addr + 1);
+    if (first == last) return 0;
+
+    Reference shown[REFERENCE_MAX_FANOUT];
+    size_t count = last - first;
+    size_t n = 0;
+    // The closest referrers: walk down from the top of the window
+    for (size_t i = last; i > first && n < REFERENCE_MAX_FANOUT; i--) shown[n++] = query->index->items[i - 1];
+    qsort(shown, n, sizeof(*shown), reference_cmp);
+
+    for (size_t i = 0; i < n; i++) {
+        const MemoryRegion *region = region_lookup(query->regions, shown[i].source, sizeof(unsigned long));
+        int fresh = address_set_insert(&query->seen, shown[i].source);
+        printf("%*s0x%lx %s -> 0x%lx", 2 * level, "", (unsigned long)shown[i].source,
+               region && region->pathname[0] ? region->pathname : "[anonymous]", (unsigned long)shown[i].target);
+        if (shown[i].target != addr) printf(" (+%lu)", addr - (unsigned long)shown[i].target);
+        printf("%s\n", fresh == 0 ? " (shown above)" : "");
+        if (fresh == 1 && level < query->depth) print_referrers(query, shown[i].source, level + 1);
+    }
+    if (count > n) printf("%*s... and %zu more\n", 2 * level, "", count - n);
+    return count;
+}
+
+// Print what references each root, up to depth levels of referrers
+void print_references(const ReferenceList *index, const RegionTable *regions, const unsigned long *roots,
+                      int root_count, int depth, size_t window) {
+    ReferenceQuery query = { index, regions, window, depth, { NULL, 0, 0 } };
+    for (int r = 0; r < root_count; r++) {
+        const MemoryRegion *region = region_lookup(regions, roots[r], 1);
+        printf("\nReferences to 0x%lx %s:\n", roots[r],
+               !region ? "(unmapped)" : region->pathname[0] ? region->pathname : "[anonymous]");
+        address_set_insert(&query.seen, roots[r]);
+        if (print_referrers(&query, roots[r], 1) == 0) printf("  none\n");
+    }
+    free(query.seen.items);
+}
+
+// ---- Entropy detection ----
+// --entropy looks for key material without knowing the key. Random bytes
+// are nearly all distinct, while code, pointers, text and padding repeat,
+// so each region streams once through 16- and 32-byte sliding windows
+// whose byte histograms are updated a byte at a time. The sum of c*log2(c)
+// over a histogram, kept in fixed point, gives its Shannon entropy in O(1)
+// per byte. Runs of one repeated byte, zero pages and fills, most of a
+// process, are skipped 64 bytes per vector compare. A window half a bit
+// below the maximum starts a run of high-entropy windows, which lasts
+// until one is a full bit below, so random data, which dips now and then,
+// is one run. A run spanning more than
+// ENTROPY_MAX_SPAN windows is a compressed or encrypted buffer and is
+// dropped, otherwise its most random window competes for the top N. Only
+// writable regions are read and windows of mostly text never count: code,
+// constants and the environment are dense too, and keys are made at run
+// time.
+
+#define ENTROPY_TOP_DEFAULT 20
+#define ENTROPY_MAX_WIDTH 32
+#define ENTROPY_MAX_SPAN 4      // Longest run kept, in window widths
+#define ENTROPY_SCALE 65536     // Fixed point of entropy_clog
+
+// c * log2(c) * ENTROPY_SCALE, rounded
+static const uint32_t entropy_clog[ENTROPY_MAX_WIDTH + 1] = {
+    0, 0, 131072, 311616, 524288, 760849,
+    1016449, 1287880, 1572864, 1869698, 2177059, 2493890,
+    2819329, 3152656, 3493263, 3840630, 4194304, 4553891,
+    4919044, 5289451, 5664838, 6044953, 6429573, 6818492,
+    7211522, 7608494, 8009248, 8413640, 8821535, 9232807,
+    9647339, 10065024, 10485760,
+};
+
+typedef struct {
+    unsigned long addr;
+    uint32_t sum;               // Of c*log2(c), lower is more random
+    unsigned zeros;             // Zero bytes, padding more often than key
+    const MemoryRegion *region;
+    unsigned char bytes[ENTROPY_MAX_WIDTH];
+} EntropyHit;
+
+typedef struct {
+    size_t width;
+    int bits;                   // log2(width), the entropy of distinct bytes
+    uint32_t start_sum;         // Highest sum starting a run
+    uint32_t end_sum;           // Lowest sum ending it
+    unsigned char counts[256];
+    uint32_t sum;
+    size_t text;                // Printable ASCII bytes
+    size_t run;                 // High-entropy windows in a row so far
+    EntropyHit best;            // The most random of them
+    EntropyHit *top;            // Min-heap, least random at the root
+    size_t top_count;
+    size_t top_max;
+    size_t dropped;
+} EntropyWindow;
+
+// Bytes equal to v at the start of a 64-byte block
+typedef size_t (*EntropyRepeatFn)(const unsigned char *block, unsigned char v);
+
+typedef struct {
+    const MemoryRegion *region;
+    EntropyRepeatFn repeat_length;
+    unsigned char ring[ENTROPY_MAX_WIDTH]; // Byte at addr in ring[addr % 32]
+    size_t filled;              // Bytes of the region seen
+    unsigned char last;         // The last byte, repeated this many times
+    size_t repeats;
+    EntropyWindow windows[2];
+} EntropyScan;
+
+static size_t entropy_repeat_portable(const unsigned char *block, unsigned char v) {
+    uint64_t fill = 0x0101010101010101ULL * v;
+    for (size_t i = 0; i < 64; i += 8) {
+        uint64_t word;
+        memcpy(&word, block + i, sizeof(word));
+        // Little-endian: the first differing byte is the lowest set bit
+        if (word != fill) return i + __builtin_ctzll(word ^ fill) / 8;
+    }
+    return 64;
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("avx2")))
+static size_t entropy_repeat_avx2(const unsigned char *block, unsigned char v) {
+    __m256i fill = _mm256_set1_epi8((char)v);
+    uint64_t same = (uint32_t)_mm256_movemask_epi8(
+                        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)block), fill)) |
+                    (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(block + 32)), fill)) << 32;
+    return ~same ? (size_t)__builtin_ctzll(~same) : 64;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t entropy_repeat_avx512(const unsigned char *block, unsigned char v) {
+    uint64_t same = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const void *)block), _mm512_set1_epi8((char)v));
+    return ~same ? (size_t)__builtin_ctzll(~same) : 64;
+}
+#endif
+
+static EntropyRepeatFn select_entropy_repeat(void) {
+    #ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) return entropy_repeat_avx512;
+    if (__builtin_cpu_supports("avx2")) return entropy_repeat_avx2;
+    #endif
+    return entropy_repeat_portable;
+}
+
+// Whether a is less random than b; fewer zeros, then earlier addresses win ties
+static int entropy_hit_worse(const EntropyHit *a, const EntropyHit *b) {
+    if (a->sum != b->sum) return a->sum > b->sum;
+    if (a->zeros != b->zeros) return a->zeros > b->zeros;
+    return a->addr > b->addr;
+}
+
+static void entropy_top_add(EntropyWindow *window, const EntropyHit *hit) {
+    EntropyHit *top = window->top;
+    size_t i;
+    if (window->top_count < window->top_max) {
+        i = window->top_count++;
+        while (i > 0 && entropy_hit_worse(hit, &top[(i - 1) / 2])) {
+            top[i] = top[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else {
+        if (!entropy_hit_worse(&top[0], hit)) return;
+        i = 0;
+        for (;;) {
+            size_t child = 2 * i + 1;
+            if (child >= window->top_count) break;
+            if (child + 1 < window->top_count && entropy_hit_worse(&top[child + 1], &top[child])) child++;
+            if (!entropy_hit_worse(&top[child], hit)) break;
+            top[i] = top[child];
+            i = child;
+        }
+    }
+    top[i] = *hit;
+}
+
+static void entropy_run_end(EntropyWindow *window) {
+    if (window->run == 0) return;
+    if (window->run + window->width - 1 <= ENTROPY_MAX_SPAN * window->width) {
+        entropy_top_add(window, &window->best);
+    } else {
+        window->dropped++;
+    }
+    window->run = 0;
+}
+
+// Slide the window to end with b at addr, dropping out if it was full
+static void entropy_window_step(EntropyScan *scan, EntropyWindow *window, unsigned long addr,
+                                unsigned char b, unsigned char out) {
+    size_t width = window->width;
+    if (scan->filled > width) {
+        unsigned c = window->counts[out]--;
+        window->sum -= entropy_clog[c] - entropy_clog[c - 1];
+        window->text -= out >= 0x20 && out < 0x7f;
+    }
+    unsigned c = window->counts[b]++;
+    window->sum += entropy_clog[c + 1] - entropy_clog[c];
+    window->text += b >= 0x20 && b < 0x7f;
+    if (scan->filled < width) return;
+
+    // Random bytes are printable 37% of the time, text nearly always. Text
+    // neither starts a run nor is its best window, but does not end it.
+    int text = window->text >= width - width / 8;
+    if (window->sum > (window->run ? window->end_sum : window->start_sum) || (text && !window->run)) {
+        entropy_run_end(window);
+        return;
+    }
+    EntropyHit *best = &window->best;
+    if (window->run++ == 0 || (!text && (window->sum < best->sum ||
+                                         (window->sum == best->sum && window->counts[0] < best->zeros)))) {
+        unsigned long start = addr - width + 1;
+        best->addr = start;
+        best->sum = window->sum;
+        best->zeros = window->counts[0];
+        best->region = scan->region;
+        for (size_t i = 0; i < width; i++) {
+            best->bytes[i] = scan->ring[(start + i) % ENTROPY_MAX_WIDTH];
+        }
+    }
+}
+
+static void entropy_feed(const unsigned char *data, size_t len, unsigned long addr, void *ctx) {
+    EntropyScan *scan = ctx;
+    for (size_t off = 0; off < len; ) {
+        size_t n = (len - off < 64) ? len - off : 64;
+        size_t i = 0;
+        if (n == 64 && scan->repeats >= ENTROPY_MAX_WIDTH) {
+            // Every window holds only the repeated byte already, nothing
+            // changes until another byte comes
+            i = scan->repeat_length(data + off, scan->last);
+            scan->filled += i;
+            scan->repeats += i;
+        }
+        for (; i < n; i++) {
+            unsigned long a = addr + off + i;
+            unsigned char b = data[off + i];
+            // The byte leaving the 32-byte window has the slot b goes in
+            unsigned char out16 = scan->ring[(a - 16) % ENTROPY_MAX_WIDTH];
+            unsigned char out32 = scan->ring[a % ENTROPY_MAX_WIDTH];
+            scan->ring[a % ENTROPY_MAX_WIDTH] = b;
+            scan->filled++;
+            scan->repeats = (b == scan->last) ? scan->repeats + 1 : 1;
+            scan->last = b;
+            entropy_window_step(scan, &scan->windows[0], a, b, out16);
+            entropy_window_step(scan, &scan->windows[1], a, b, out32);
+        }
+        off += n;
+    }
+}
+
+static int entropy_hit_compare(const void *a, const void *b) {
+    const EntropyHit *x = a, *y = b;
+    if (entropy_hit_worse(x, y)) return 1;
+    return entropy_hit_worse(y, x) ? -1 : 0;
+}
+
+// Rank the most random 16- and 32-byte windows of the given regions, top
+// of each, and print them. Budgets work as for scans. Returns -1 on
+// allocation failure.
+int detect_entropy(MemoryReader *reader, MemoryRegion *const *regions, int count, size_t top,
+                   size_t chunk_size, size_t max_region_bytes, size_t max_total_bytes) {
+    EntropyScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.repeat_length = select_entropy_repeat();
+    for (int w = 0; w < 2; w++) {
+        EntropyWindow *window = &scan.windows[w];
+        window->width = w ? 32 : 16;
+        window->bits = w ? 5 : 4;
+        // Half a bit and a bit below all distinct bytes
+        window->start_sum = window->width * ENTROPY_SCALE / 2;
+        window->end_sum = window->width * ENTROPY_SCALE;
+        window->top_max = top;
+        window->top = malloc(top * sizeof(*window->top));
+    }
+    ReadBuffer buffer;
+    int failed = !scan.windows[0].top || !scan.windows[1].top || read_buffer_init(&buffer, chunk_size) != 0;
+
+    size_t remaining = max_total_bytes;
+    for (int i = 0; i < count && !failed; i++) {
+        MemoryRegion *region = regions[i];
+        if (!region_is_scannable(region) || region->permissions[1] != 'w') continue;
+        size_t size = region->end - region->start;
+        if (max_region_bytes && size > max_region_bytes) size = max_region_bytes;
+        if (max_total_bytes) {
+            if (size > remaining) size = remaining;
+            remaining -= size;
+        }
+        if (size == 0) continue;
+
+        // Windows stop at region boundaries
+        scan.region = region;
+        scan.filled = 0;
+        scan.repeats = 0;
+        for (int w = 0; w < 2; w++) {
+            memset(scan.windows[w].counts, 0, sizeof(scan.windows[w].counts));
+            scan.windows[w].sum = 0;
+            scan.windows[w].text = 0;
+        }
+        read_range_chunks(reader, &buffer, region->start, region->start + size, entropy_feed, &scan);
+        entropy_run_end(&scan.windows[0]);
+        entropy_run_end(&scan.windows[1]);
+    }
+
+    for (int w = 0; w < 2 && !failed; w++) {
+        EntropyWindow *window = &scan.windows[w];
+        qsort(window->top, window->top_count, sizeof(*window->top), entropy_hit_compare);
+        printf("\nMost random %zu-byte windows (%zu larger high-entropy buffers skipped):\n",
+               window->width, window->dropped);
+        if (window->top_count == 0) printf("  none\n");
+        for (size_t i = 0; i < window->top_count; i++) {
+            const EntropyHit *hit = &window->top[i];
+            printf("  0x%lx %.3f bits %s:", hit->addr,
+                   window->bits - (double)hit->sum / (window->width * ENTROPY_SCALE),
+                   hit->region->pathname[0] ? hit->region->pathname : "[anonymous]");
+            for (size_t j = 0; j < window->width; j++) printf(" %02x", hit->bytes[j]);
+            printf("\n");
+        }
+    }
+
+    if (!failed) read_buffer_free(&buffer);
+    free(scan.windows[0].top);
+    free(scan.windows[1].top);
+    return failed ? -1 : 0;
+}
+
+// ---- Watch mode ----
+// --watch[=SECONDS] rescans a live target every SECONDS and reads only the
+// pages written since the previous pass. After the first scan the
+// soft-dirty bits of the target's page tables are cleared by writing 4 to
+// /proc/<pid>/clear_refs; the kernel sets a page's bit again on its next
+// write, and pagemap reports it as bit 55. Each pass stops the target,
+// collects the dirty pages, clears the bits and scans those pages together
+// with the longest match length before them, so matches reaching into a
+// dirty page are found again; matches elsewhere carry over. New regions,
+// and the part of a region that grew, are scanned in full. Matches that
+// appear or disappear are printed as events. Kernels built without
+// soft-dirty support never set the bit: then every page is read and
+// hashed instead, and pages whose hash changed are scanned, which saves
+// the scan but not the read.
+
+#define WATCH_INTERVAL_DEFAULT 5
+#define PAGEMAP_SOFT_DIRTY (1ULL << 55)
+#define WATCH_PAGES ((16 * 1024 * 1024) / page_size) // Pages per pagemap or hashing read
+#define WATCH_EVENT_BYTES 32    // Match bytes shown per event
+
+typedef struct {
+    MemoryRegion *region;       // In the table of the pass that made it
+    unsigned long start;
+    unsigned long end;          // Scanned part of the region
+    uint64_t *hashes;           // One per page, when hashing
+} WatchRange;
+
+typedef struct {
+    ScanSlice *items;
+    size_t count;
+    size_t cap;
+} WatchSlices;
+
+typedef struct {
+    pid_t pid;
+    ReadBackend backend;
+    ScanJob job;                // The first scan's, quiet
+    SelectPolicy policy;
+    const PatternSet *set;      // For labels
+    int hashing;                // No soft-dirty bits: compare page hashes
+    size_t pad;                 // Longest match - 1
+    RegionTable regions;        // Holding the matches' regions, once a pass ran
+    int owns_regions;
+    WatchRange *ranges;         // In address order
+    int range_count;
+    MatchList matches;
+} WatchState;
+
+static volatile sig_atomic_t watch_stop;
+
+static void watch_interrupt(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+// Whether this kernel tracks soft-dirty pages: a page just written by
+// this process must have the bit set
+static int soft_dirty_supported(void) {
+    unsigned char *page = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) return 0;
+    page[0] = 1;
+    unsigned long long entry = 0;
+    int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    int supported = fd >= 0 && pagemap_read(fd, (unsigned long)page, 1, &entry) == 0 &&
+                    (entry & PAGEMAP_SOFT_DIRTY);
+    if (fd >= 0) close(fd);
+    munmap(page, page_size);
+    return supported;
+}
+
+static int clear_soft_dirty(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/clear_refs", pid);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || write(fd, "4", 1) != 1) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static void watch_ranges_free(WatchRange *ranges, int count) {
+    for (int i = 0; ranges && i < count; i++) free(ranges[i].hashes);
+    free(ranges);
+}
+
+static int watch_range_cmp(const void *a, const void *b) {
+    const WatchRange *x = a, *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+// The part of each selected region a scan covers under the job's budgets,
+// in address order. Returns NULL on allocation failure.
+static WatchRange *watch_ranges(ScanJob *job, MemoryRegion *const *selected, int count, int *range_count) {
+    WatchRange *ranges = calloc(count > 0 ? count : 1, sizeof(*ranges));
+    if (!ranges) return NULL;
+    int n = 0;
+    size_t remaining = job->max_total_bytes;
+    for (int i = 0; i < count; i++) {
+        if (!region_is_scannable(selected[i])) continue;
+        unsigned long end = region_scan_end(job, selected[i], remaining);
+        if (end == selected[i]->start) continue;
+        remaining -= (job->max_total_bytes) ? end - selected[i]->start : 0;
+        ranges[n].region = selected[i];
+        ranges[n].start = selected[i]->start;
+        ranges[n].end = end;
+        n++;
+    }
+    qsort(ranges, n, sizeof(*ranges), watch_range_cmp);
+    *range_count = n;
+    return ranges;
+}
+
+// Hash every page of the range; pages of old, if given, that hash
+// differently are marked in changed
+static int watch_hash_range(MemoryReader *reader, WatchRange *range, const WatchRange *old,
+                            unsigned char *buf, unsigned char *changed) {
+    size_t pages = (range->end - range->start + page_size - 1) / page_size;
+    size_t old_pages = old ? (old->end - old->start + page_size - 1) / page_size : 0;
+    range->hashes = malloc((pages ? pages : 1) * sizeof(uint64_t));
+    if (!range->hashes) return -1;
+    for (size_t p = 0; p < pages; p += WATCH_PAGES) {
+        size_t n = (pages - p < WATCH_PAGES) ? pages - p : WATCH_PAGES;
+        ReadRequest req = { range->start + p * page_size, buf, n * page_size };
+        read_process_memory_batch(reader, &req, 1);
+        for (size_t i = 0; i < n; i++) {
+            range->hashes[p + i] = xxh64(buf + i * page_size, page_size, 0);
+            if (changed && p + i < old_pages) changed[p + i] = range->hashes[p + i] != old->hashes[p + i];
+        }
+    }
+    return 0;
+}
+
+// Add [start, end) of region to the slices to scan, merging with the last
+static int watch_add_slice(WatchSlices *slices, MemoryRegion *region, unsigned long start, unsigned long end) {
+    if (slices->count > 0) {
+        ScanSlice *last = &slices->items[slices->count - 1];
+        if (last->region == region && start <= last->end) {
+            if (end > last->end) last->end = end;
+            return 0;
+        }
+    }
+    if (slices->count == slices->cap) {
+        size_t cap = slices->cap ? slices->cap * 2 : 64;
+        ScanSlice *items = realloc(slices->items, cap * sizeof(*items));
+        if (!items) return -1;
+        slices->items = items;
+        slices->cap = cap;
+    }
+    ScanSlice *slice = &slices->items[slices->count++];
+    slice->region = region;
+    slice->start = start;
+    slice->end = end;
+    return 0;
+}
+
+// The slices to rescan in range: its changed pages, each with the pad
+// bytes before it, and whatever lies past the end of old
+static int watch_changed_slices(WatchState *watch, MemoryReader *reader, int pagemap_fd,
+                                WatchRange *range, const WatchRange *old, unsigned char *buf,
+                                unsigned long long *entries, unsigned char *changed,
+                                WatchSlices *slices) {
+    unsigned long known_end = old ? (old->end < range->end ? old->end : range->end) : range->start;
+    size_t known_pages = (known_end - range->start + page_size - 1) / page_size;
+    if (watch->hashing && watch_hash_range(reader, range, old, buf, changed) != 0) return -1;
+
+    for (size_t p = 0; p < known_pages; p += WATCH_PAGES) {
+        size_t n = (known_pages - p < WATCH_PAGES) ? known_pages - p : WATCH_PAGES;
+        const unsigned char *dirty = changed + p;
+        if (!watch->hashing) {
+            // Unreadable pagemap: rescan it all
+            int read = pagemap_read(pagemap_fd, range->start + p * page_size, n, entries) == 0;
+            for (size_t i = 0; i < n; i++) changed[i] = !read || (entries[i] & PAGEMAP_SOFT_DIRTY);
+            dirty = changed;
+        }
+        for (size_t i = 0; i < n; ) {
+            if (!dirty[i]) {
+                i++;
+                continue;
+            }
+            size_t run = i;
+            while (run < n && dirty[run]) run++;
+            unsigned long start = range->start + (p + i) * page_size;
+            unsigned long end = range->start + (p + run) * page_size;
+            if (end > known_end) end = known_end;
+            start = (start - range->start > watch->pad) ? start - watch->pad : range->start;
+            if (watch_add_slice(slices, range->region, start, end) != 0) return -1;
+            i = run;
+        }
+    }
+    if (known_end < range->end) {
+        unsigned long start = (known_end - range->start > watch->pad) ? known_end - watch->pad : range->start;
+        if (watch_add_slice(slices, range->region, start, range->end) != 0) return -1;
+    }
+    return 0;
+}
+
+// Index of the range or slice holding addr, or -1. Both are in address order.
+static long watch_range_find(const WatchRange *ranges, int count, unsigned long addr) {
+    long lo = 0, hi = count - 1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (addr < ranges[mid].start) {
+            hi = mid - 1;
+        } else if (addr >= ranges[mid].end) {
+            lo = mid + 1;
+        } else {
+            return mid;
+        }
+    }
+    return -1;
+}
+
+static int watch_slice_holds(const WatchSlices *slices, unsigned long addr) {
+    long lo = 0, hi = (long)slices->count - 1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (addr < slices->items[mid].start) {
+            hi = mid - 1;
+        } else if (addr >= slices->items[mid].end) {
+            lo = mid + 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Copy one match of src, with its bytes, to the end of dst
+static int match_list_copy(MatchList *dst, const MatchList *src, const Match *match, MemoryRegion *region) {
+    if (match_list_reserve(dst, 1, match->context_len) != 0) return -1;
+    Match *copy = &dst->items[dst->count++];
+    *copy = *match;
+    copy->region = region;
+    copy->context_off = dst->bytes_len;
+    memcpy(dst->bytes + dst->bytes_len, src->bytes + match->context_off, match->context_len);
+    dst->bytes_len += match->context_len;
+    return 0;
+}
+
+static void print_watch_event(const WatchState *watch, const MatchList *list, const Match *match, char sign) {
+    printf("  %c 0x%lx %s", sign, match->addr,
+           match->region->pathname[0] ? match->region->pathname : "[anonymous]");
+    if (watch->set && match->pattern >= 0) printf(" %s", watch->set->patterns[match->pattern].label);
+    printf(":");
+    const unsigned char *bytes = list->bytes + match->context_off + match->context_before;
+    unsigned shown = match->match_len < WATCH_EVENT_BYTES ? match->match_len : WATCH_EVENT_BYTES;
+    for (unsigned i = 0; i < shown; i++) printf(" %02x", bytes[i]);
+    printf("%s\n", shown < match->match_len ? " ..." : "");
+}
+
+// Walk the old and new matches, both sorted, and print or count the
+// differences
+static void watch_diff(const WatchState *watch, const MatchList *old, const MatchList *now, int print,
+                       size_t *appeared, size_t *disappeared) {
+    size_t i = 0, j = 0;
+    *appeared = *disappeared = 0;
+    while (i < old->count || j < now->count) {
+        int order = (i == old->count) ? 1 : (j == now->count) ? -1 :
+                    compare_matches(&old->items[i], &now->items[j]);
+        if (order < 0) {
+            if (print) print_watch_event(watch, old, &old->items[i], '-');
+            (*disappeared)++;
+            i++;
+        } else if (order > 0) {
+            if (print) print_watch_event(watch, now, &now->items[j], '+');
+            (*appeared)++;
+            j++;
+        } else {
+            i++;
+            j++;
+        }
+    }
+}
+
+// Remember the first scan's matches and regions and start tracking
+// writes. Called with the target stopped, before it is detached.
+int watch_begin(WatchState *watch, MemoryReader *reader, const ScanJob *job, const SelectPolicy *policy,
+                const PatternSet *set, MemoryRegion *const *selected, int count, const MatchList *matches) {
+    memset(watch, 0, sizeof(*watch));
+    watch->pid = reader->pid;
+    watch->backend = reader->backend;
+    watch->job = *job;
+    watch->job.quiet = 1;
+    watch->job.progress = 0;
+    watch->policy = *policy;
+    watch->set = set;
+    size_t max_len = job->regex ? job->regex->max_len : job->set ? job->set->max_len :
+                     job->value ? job->value->width : job->pattern->len;
+    watch->pad = max_len - 1;
+    watch->ranges = watch_ranges(&watch->job, selected, count, &watch->range_count);
+    if (!watch->ranges || match_list_append(&watch->matches, matches) != 0) return -1;
+
+    watch->hashing = !soft_dirty_supported() || clear_soft_dirty(watch->pid) != 0;
+    if (watch->hashing) {
+        printf("\nNo soft-dirty page tracking here; watching by hashing every page\n");
+        unsigned char *buf = alloc_read_buffer(WATCH_PAGES * page_size);
+        if (!buf) return -1;
+        for (int i = 0; i < watch->range_count; i++) {
+            if (watch_hash_range(reader, &watch->ranges[i], NULL, buf, NULL) != 0) {
+                free(buf);
+                return -1;
+            }
+        }
+        free(buf);
+    }
+    return 0;
+}
+
+// The slices of every range that changed since the last pass, and the
+// bytes the ranges cover. Returns -1 on allocation failure.
+static int watch_collect(WatchState *watch, MemoryReader *reader, WatchRange *ranges, int range_count,
+                         WatchSlices *slices, size_t *total) {
+    size_t max_pages = WATCH_PAGES;
+    for (int i = 0; i < range_count; i++) {
+        size_t pages = (ranges[i].end - ranges[i].start + page_size - 1) / page_size;
+        if (pages > max_pages) max_pages = pages;
+    }
+    // Soft-dirty marks are per pagemap read, hash marks per range
+    unsigned char *changed = malloc(watch->hashing ? max_pages : WATCH_PAGES);
+    unsigned long long *entries = malloc(WATCH_PAGES * sizeof(*entries));
+    unsigned char *buf = watch->hashing ? alloc_read_buffer(WATCH_PAGES * page_size) : NULL;
+    int failed = !changed || !entries || (watch->hashing && !buf);
+    int pagemap_fd = -1;
+    if (!watch->hashing) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/pagemap", watch->pid);
+        pagemap_fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    *total = 0;
+    for (int i = 0; i < range_count && !failed; i++) {
+        WatchRange *range = &ranges[i];
+        long o = watch_range_find(watch->ranges, watch->range_count, range->start);
+        const WatchRange *old = (o >= 0 && watch->ranges[o].start == range->start) ? &watch->ranges[o] : NULL;
+        failed = watch_changed_slices(watch, reader, pagemap_fd, range, old, buf, entries, changed, slices) != 0;
+        *total += range->end - range->start;
+    }
+
+    if (pagemap_fd >= 0) close(pagemap_fd);
+    free(changed);
+    free(entries);
+    free(buf);
+    return failed ? -1 : 0;
+}
+
+// The matches after a pass: those found in the rescanned slices, and the
+// old ones that started elsewhere in a range still scanned
+static int watch_merge(const WatchState *watch, const WatchRange *ranges, int range_count,
+                       const WatchSlices *slices, const MatchList *found, MatchList *next) {
+    match_list_init(next);
+    for (size_t i = 0; i < watch->matches.count; i++) {
+        const Match *match = &watch->matches.items[i];
+        long r = watch_range_find(ranges, range_count, match->addr);
+        if (r < 0 || match->addr + match->match_len > ranges[r].end) continue;
+        if (watch_slice_holds(slices, match->addr)) continue;
+        if (match_list_copy(next, &watch->matches, match, ranges[r].region) != 0) return -1;
+    }
+    if (match_list_append(next, found) != 0) return -1;
+    match_list_sort(next);
+    return 0;
+}
+
+// One pass: stop the target, rescan what changed and report the
+// differences. Returns -1 once the target is gone or on errors.
+static int watch_pass(WatchState *watch, int pass) {
+    double stop_start = now_seconds();
+    if (ptrace(PTRACE_ATTACH, watch->pid, NULL, NULL) == -1) {
+        // Exited, or a zombie, which cannot be attached either
+        printf("Cannot stop target %d any more: %s\n", watch->pid, strerror(errno));
+        return -1;
+    }
+    int status;
+    waitpid(watch->pid, &status, 0);
+
+    RegionTable table;
+    if (read_memory_regions(watch->pid, &table) != 0) {
+        ptrace(PTRACE_DETACH, watch->pid, NULL, NULL);
+        return -1;
+    }
+    region_table_join_smaps(watch->pid, &table);
+    MemoryRegion **selected = malloc((table.count > 0 ? table.count : 1) * sizeof(*selected));
+    MemoryReader reader;
+    reader.mem_fd = -1;
+    ScanJob job = watch->job;
+    job.reader = &reader;
+    WatchRange *ranges = NULL;
+    int range_count = 0;
+    WatchSlices slices = { NULL, 0, 0 };
+    MatchList found, next;
+    match_list_init(&found);
+    match_list_init(&next);
+    size_t total = 0;
+
+    int failed = !selected;
+    if (!failed) {
+        int selected_count = select_regions(&table, &watch->policy, selected);
+        memory_reader_open(&reader, watch->pid, watch->backend, table.items, table.count);
+        ranges = watch_ranges(&job, selected, selected_count, &range_count);
+        failed = !ranges || watch_collect(watch, &reader, ranges, range_count, &slices, &total) != 0;
+    }
+    // Writes from here on count for the next pass
+    if (!failed && !watch->hashing) clear_soft_dirty(watch->pid);
+    if (!failed) failed = scan_slices(&job, slices.items, slices.count, &found) != 0;
+    if (!failed) failed = watch_merge(watch, ranges, range_count, &slices, &found, &next) != 0;
+
+    memory_reader_close(&reader);
+    ptrace(PTRACE_DETACH, watch->pid, NULL, NULL);
+    double stopped_ms = (now_seconds() - stop_start) * 1000;
+
+    if (!failed) {
+        size_t scanned = 0, appeared, disappeared;
+        for (size_t i = 0; i < slices.count; i++) scanned += slices.items[i].end - slices.items[i].start;
+        watch_diff(watch, &watch->matches, &next, 0, &appeared, &disappeared);
+        printf("Pass %d: scanned %zu of %zu kB, %zu matches (+%zu -%zu), target stopped for %.3f ms\n",
+               pass, scanned / 1024, total / 1024, next.count, appeared, disappeared, stopped_ms);
+        watch_diff(watch, &watch->matches, &next, 1, &appeared, &disappeared);
+        fflush(stdout);
+
+        // This pass's regions and matches replace the last
+        match_list_free(&watch->matches);
+        watch->matches = next;
+        watch_ranges_free(watch->ranges, watch->range_count);
+        watch->ranges = ranges;
+        watch->range_count = range_count;
+        if (watch->owns_regions) region_table_free(&watch->regions);
+        watch->regions = table;
+        watch->owns_regions = 1;
+    } else {
+        printf("Out of memory while watching\n");
+        match_list_free(&next);
+        watch_ranges_free(ranges, range_count);
+        region_table_free(&table);
+    }
+    match_list_free(&found);
+    free(slices.items);
+    free(selected);
+    return failed ? -1 : 0;
+}
+
+// Rescan every interval seconds until interrupted or the target exits
+void watch_run(WatchState *watch, int interval) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = watch_interrupt;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("\nWatching PID %d every %d s, Ctrl-C to stop\n", watch->pid, interval);
+    fflush(stdout);
+    for (int pass = 1; !watch_stop; pass++) {
+        struct timespec delay = { interval, 0 };
+        while (!watch_stop && nanosleep(&delay, &delay) != 0 && errno == EINTR) {}
+        if (watch_stop || watch_pass(watch, pass) != 0) break;
+    }
+}
+
+void watch_free(WatchState *watch) {
+    match_list_free(&watch->matches);
+    watch_ranges_free(watch->ranges, watch->range_count);
+    if (watch->owns_regions) region_table_free(&watch->regions);
+}
+
+// Parse a byte count with an optional K, M or G suffix
+int parse_size(const char *text, size_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 0);
+    if (errno != 0 || end == text) return -1;
+    
+    switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    }
+    if (*end != '\0') return -1;
+    *size = value;
+    return 0;
+}
+
+void print_usage(const char *prog) {
+    printf("Usage: %s [options] <target_pid>\n", prog);
+    printf("Or use: %s [options] <pid>... | --name=NAMES | --cgroup=PATH\n", prog);
+    printf("Or use: %s [options] --launch-target\n", prog);
+    printf("Or use: %s [options] --offline DUMP...\n", prog);
+    printf("Or use: %s --restore=MANIFEST | --extract=FILE[@START-END]\n", prog);
+    printf("\nOptions:\n");
+    printf("  --backend=NAME    Memory read backend: auto, vm, mem, ptrace (default: auto)\n");
+    printf("  -c, --chunk-size=SIZE\n");
+    printf("                    Bytes scanned per chunk, e.g. 4K or 8M (default: 1M)\n");
+    printf("  -t, --threads=N   Scan with N threads (default: online CPUs)\n");
+    printf("  --max-region-bytes=SIZE\n");
+    printf("                    Scan at most SIZE bytes of each region (default: all)\n");
+    printf("  --max-total-bytes=SIZE\n");
+    printf("                    Stop scanning after SIZE bytes in total (default: all)\n");
+    printf("  --progress, --no-progress\n");
+    printf("                    Show scan progress on stderr (default: when a terminal)\n");
+    printf("  --pattern=BYTES   Search for BYTES instead of asking, e.g. \"4a ?? 32 8? d1\":\n");
+    printf("                    ?? is any byte, 8? or ?8 any nibble, XX/MM a byte\n");
+    printf("                    whose MM bits equal XX\n");
+    printf("  --regex=RE        Search for a byte-level regular expression: literals,\n");
+    printf("                    \\xHH, \\n, \\d \\w \\s, . (any byte), [classes], (groups),\n");
+    printf("                    |, *, +, ?, {n,m}; a leading (?i) ignores case. Matches\n");
+    printf("                    are leftmost-longest, at most %d bytes\n", REGEX_MAX_MATCH);
+    printf("  --value=TYPE:SPEC Search for numbers: TYPE is i8, u8, i16, u16, i32, u32,\n");
+    printf("                    i64, u64, f32, f64 or ptr; SPEC is V, LO..HI or, for\n");
+    printf("                    floats, V~EPS. Values are read at multiples of their\n");
+    printf("                    size unless --unaligned asks for every offset\n");
+    printf("  --candidates=FILE Save the addresses and bytes matched by --value or\n");
+    printf("                    --pattern to FILE for --narrow\n");
+    printf("  --narrow=FILE     Reread only the candidates in FILE and keep those that\n");
+    printf("                    match --value or pass --keep=changed, unchanged,\n");
+    printf("                    increased or decreased; the survivors are saved back\n");
+    printf("                    to FILE (or --candidates)\n");
+    printf("  --references[=ADDR,...]\n");
+    printf("                    Show which words point at each ADDR (hex), or at the\n");
+    printf("                    first matches of the search, and what points at them\n");
+    printf("  --depth=N         Levels of referrers to follow (default: %d)\n", REFERENCE_DEPTH_DEFAULT);
+    printf("  --ref-window=SIZE A pointer at most SIZE - 1 bytes below an address\n");
+    printf("                    references it (default: %d)\n", REFERENCE_WINDOW_DEFAULT);
+    printf("  -p, --patterns=FILE\n");
+    printf("                    Search for every pattern in FILE in one pass, one per\n");
+    printf("                    line as \"[label:] hex bytes\" (any length)\n");
+    printf("  --snapshot=DIR    Store dumped regions in the snapshot store DIR, keeping\n");
+    printf("                    each distinct page once, instead of dump_region_*.bin\n");
+    printf("  --restore=MANIFEST\n");
+    printf("                    Rebuild the dump_region_*.bin files of a stored\n");
+    printf("                    snapshot (DIR/snapshot-N.mf) and exit\n");
+    printf("  --container=FILE  Write dumped regions to one compressed, indexed FILE\n");
+    printf("                    instead of dump_region_*.bin\n");
+    printf("  --extract=FILE[@START-END]\n");
+    printf("                    List the regions in a dump container, or write the\n");
+    printf("                    bytes from START to END (hex) to stdout, and exit\n");
+    printf("  --select=LIST     Regions to scan, comma-separated: heap, stack, anon,\n");
+    printf("                    file, code, all (default: all). Largest anonymous\n");
+    printf("                    resident regions are scanned first, library code last\n");
+    printf("  --min-rss=SIZE    Skip regions with less than SIZE resident or swapped\n");
+    printf("                    (default: 1, i.e. skip untouched regions)\n");
+    printf("  --capture         Copy the target's readable memory, detach at once, then\n");
+    printf("                    scan and dump the copy; reports how long it was stopped\n");
+    printf("  --name=NAMES      Scan every process whose name or executable is in the\n");
+    printf("                    comma-separated NAMES, like several PIDs\n");
+    printf("  --cgroup=PATH     Scan every process in a cgroup (relative to\n");
+    printf("                    /sys/fs/cgroup). With several processes, one per thread\n");
+    printf("                    is scanned; shared read-only library mappings are\n");
+    printf("                    scanned once and nothing is dumped\n");
+    printf("  --offline         Scan earlier dumps instead of a process. Each DUMP is a\n");
+    printf("                    directory of dump_region_*.bin files, a dump\n");
+    printf("                    container, or a raw file as FILE@ADDR (hex)\n");
+    printf("  --watch[=SECONDS] After the scan, rescan the pages written since the last\n");
+    printf("                    pass every SECONDS and report matches that appear or\n");
+    printf("                    disappear (default: %d)\n", WATCH_INTERVAL_DEFAULT);
+    printf("  --entropy[=N]     Rank the N most random 16- and 32-byte windows of writable\n");
+    printf("                    memory, likely keys, leaving out larger random buffers\n");
+    printf("                    (default: %d)\n",
+           ENTROPY_TOP_DEFAULT);
+    printf("  --strings[=MIN]   Print the ASCII and UTF-16LE strings of at least MIN\n");
+    printf("                    characters (default: %d) with their addresses and\n", STRINGS_DEFAULT_MIN);
+    printf("                    regions instead of searching; nothing is dumped\n");
+    printf("  -h, --help        Show this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    #ifdef __APPLE__
+    printf("WARNING: Running on macOS\n");
+    printf("Note: macOS has strict security restrictions on ptrace:\n");
+    printf("  - You may need to disable System Integrity Protection (SIP)\n");
+    printf("  - You may need to run with sudo\n");
+    printf("  - Code signing requirements may prevent attachment\n");
+    printf("  - /proc filesystem is not available on macOS\n");
+    printf("\nThis tool is designed for Linux. On macOS, use lldb or dtrace instead.\n\n");
+    #endif
+    
+    long kernel_page = sysconf(_SC_PAGESIZE);
+    if (kernel_page > 0) page_size = kernel_page;
+    
+    static struct option long_options[] = {
+        {"launch-target", no_argument,       0, 'l'},
+        {"backend",       required_argument, 0, 'b'},
+        {"patterns",      required_argument, 0, 'p'},
+        {"pattern",       required_argument, 0, 'e'},
+        {"regex",         required_argument, 0, 'E'},
+        {"chunk-size",    required_argument, 0, 'c'},
+        {"threads",       required_argument, 0, 't'},
+        {"max-region-bytes", required_argument, 0, 'R'},
+        {"max-total-bytes",  required_argument, 0, 'T'},
+        {"progress",      no_argument,       0, 'P'},
+        {"no-progress",   no_argument,       0, 'Q'},
+        {"snapshot",      required_argument, 0, 'S'},
+        {"restore",       required_argument, 0, 'r'},
+        {"container",     required_argument, 0, 'K'},
+        {"extract",       required_argument, 0, 'x'},
+        {"offline",       no_argument,       0, 'O'},
+        {"capture",       no_argument,       0, 'C'},
+        {"select",        required_argument, 0, 's'},
+        {"min-rss",       required_argument, 0, 'm'},
+        {"name",          required_argument, 0, 'N'},
+        {"cgroup",        required_argument, 0, 'G'},
+        {"strings",       optional_argument, 0, 'a'},
+        {"value",         required_argument, 0, 'v'},
+        {"unaligned",     no_argument,       0, 'u'},
+        {"candidates",    required_argument, 0, 'D'},
+        {"narrow",        required_argument, 0, 'n'},
+        {"keep",          required_argument, 0, 'k'},
+        {"references",    optional_argument, 0, 'F'},
+        {"depth",         required_argument, 0, 'L'},
+        {"ref-window",    required_argument, 0, 'W'},
+        {"entropy",       optional_argument, 0, 'H'},
+        {"watch",         optional_argument, 0, 'w'},
+        {"help",          no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    
+    int launch_target = 0;
+    ReadBackend requested_backend = READ_BACKEND_AUTO;
+    const char *pattern_file = NULL;
+    SearchPattern pattern;
+    int pattern_given = 0;
+    const char *regex_source = NULL;
+    size_t chunk_size = DEFAULT_CHUNK_SIZE;
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = online_cpus > 0 ? (int)online_cpus : 1;
+    size_t max_region_bytes = 0;
+    size_t max_total_bytes = 0;
+    int progress = isatty(STDERR_FILENO);
+    const char *snapshot_dir = NULL;
+    const char *restore_manifest = NULL;
+    const char *container_path = NULL;
+    const char *extract_spec = NULL;
+    int offline = 0;
+    int capture = 0;
+    SelectPolicy policy = { REGION_ALL, 1 };
+    const char *fleet_names = NULL;
+    const char *fleet_cgroup = NULL;
+    size_t strings_min = 0;
+    size_t entropy_top = 0;
+    int watch_interval = 0;
+    const char *value_spec = NULL;
+    int unaligned = 0;
+    const char *candidates_path = NULL;
+    const char *narrow_path = NULL;
+    int keep_given = 0;
+    NarrowTest keep = KEEP_VALUE;
+    int references = 0;
+    unsigned long roots[REFERENCE_MAX_ROOTS];
+    int root_count = 0;
+    int ref_depth = REFERENCE_DEPTH_DEFAULT;
+    size_t ref_window = REFERENCE_WINDOW_DEFAULT;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:p:c:t:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'l':
+            launch_target = 1;
+            break;
+        case 'b':
+            if (parse_read_backend(optarg, &requested_backend) != 0) {
+                printf("Unknown read backend: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            pattern_file = optarg;
+            break;
+        case 'e':
+            if (pattern_given) search_pattern_free(&pattern);
+            if (parse_search_pattern(optarg, &pattern) != 0) {
+                printf("Invalid pattern: %s\n", optarg);
+                return 1;
+            }
+            pattern_given = 1;
+            break;
+        case 'E':
+            regex_source = optarg;
+            break;
+        case 'c':
+            if (parse_size(optarg, &chunk_size) != 0 || chunk_size == 0) {
+                printf("Invalid chunk size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            threads = atoi(optarg);
+            if (threads < 1) {
+                printf("Invalid thread count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'R':
+        case 'T':
+            if (parse_size(optarg, opt == 'R' ? &max_region_bytes : &max_total_bytes) != 0) {
+                printf("Invalid byte budget: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'P':
+        case 'Q':
+            progress = (opt == 'P');
+            break;
+        case 'S':
+            snapshot_dir = optarg;
+            break;
+        case 'r':
+            restore_manifest = optarg;
+            break;
+        case 'K':
+            container_path = optarg;
+            break;
+        case 'x':
+            extract_spec = optarg;
+            break;
+        case 'O':
+            offline = 1;
+            break;
+        case 'C':
+            capture = 1;
+            break;
+        case 's':
+            if (parse_select_policy(optarg, &policy.classes) != 0) {
+                printf("Invalid region selection: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'm':
+            if (parse_size(optarg, &policy.min_rss) != 0) {
+                printf("Invalid minimum Rss: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'N':
+            fleet_names = optarg;
+            break;
+        case 'G':
+            fleet_cgroup = optarg;
+            break;
+        case 'v':
+            value_spec = optarg;
+            break;
+        case 'u':
+            unaligned = 1;
+            break;
+        case 'D':
+            candidates_path = optarg;
+            break;
+        case 'n':
+            narrow_path = optarg;
+            break;
+        case 'k':
+            if (strcmp(optarg, "changed") == 0) keep = KEEP_CHANGED;
+            else if (strcmp(optarg, "unchanged") == 0) keep = KEEP_UNCHANGED;
+            else if (strcmp(optarg, "increased") == 0) keep = KEEP_INCREASED;
+            else if (strcmp(optarg, "decreased") == 0) keep = KEEP_DECREASED;
+            else {
+                printf("Invalid test: %s\n", optarg);
+                return 1;
+            }
+            keep_given = 1;
+            break;
+        case 'F':
+            references = 1;
+            for (char *c = optarg; c && *c; ) {
+                char *end;
+                unsigned long addr = strtoul(c, &end, 16);
+                if (end == c || (*end && *end != ',') || root_count == REFERENCE_MAX_ROOTS) {
+                    printf("Invalid address list: %s\n", optarg);
+                    return 1;
+                }
+                roots[root_count++] = addr;
+                c = *end ? end + 1 : end;
+            }
+            break;
+        case 'L':
+            ref_depth = atoi(optarg);
+            if (ref_depth < 1 || ref_depth > 16) {
+                printf("Invalid depth: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'W':
+            if (parse_size(optarg, &ref_window) != 0 || ref_window == 0) {
+                printf("Invalid reference window: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'a':
+            strings_min = STRINGS_DEFAULT_MIN;
+            if (optarg && (parse_size(optarg, &strings_min) != 0 || strings_min == 0)) {
+                printf("Invalid minimum string length: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'w':
+            watch_interval = optarg ? atoi(optarg) : WATCH_INTERVAL_DEFAULT;
+            if (watch_interval < 1) {
+                printf("Invalid watch interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'H':
+            entropy_top = ENTROPY_TOP_DEFAULT;
+            if (optarg && (parse_size(optarg, &entropy_top) != 0 || entropy_top == 0)) {
+                printf("Invalid number of windows: %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    
+    // Restoring and extracting work from the files alone, no target involved
+    if (restore_manifest) {
+        return snapshot_restore(restore_manifest) == 0 ? 0 : 1;
+    }
+    if (extract_spec) {
+        return container_extract(extract_spec) == 0 ? 0 : 1;
+    }
+    if ((pattern_file != NULL) + pattern_given + (regex_source != NULL) + (value_spec != NULL) +
+        (strings_min != 0) + (entropy_top != 0) > 1) {
+        printf("--pattern, --patterns, --regex, --value, --strings and --entropy are mutually\n"
+               "exclusive\n");
+        return 1;
+    }
+    ValueQuery value;
+    if (value_spec && parse_value_query(value_spec, unaligned, &value) != 0) {
+        printf("Invalid value: %s\n", value_spec);
+        return 1;
+    }
+    if (narrow_path && (pattern_file || pattern_given || regex_source || strings_min || entropy_top ||
+                        keep_given == (value_spec != NULL))) {
+        printf("--narrow takes either --keep or --value, and no other search\n");
+        return 1;
+    }
+    if (keep_given && !narrow_path) {
+        printf("--keep needs --narrow\n");
+        return 1;
+    }
+    // Addresses given: look them up only. None: look up what the scan finds.
+    int refs_only = root_count > 0;
+    if (references && (strings_min || entropy_top || narrow_path || (refs_only && (pattern_file || pattern_given ||
+                                                                    regex_source || value_spec)))) {
+        printf("--references=ADDR looks addresses up without searching; plain --references\n"
+               "looks up the matches of a search\n");
+        return 1;
+    }
+    if (candidates_path && !narrow_path && (pattern_file || regex_source || strings_min || entropy_top || refs_only)) {
+        printf("--candidates saves the matches of --value or a single --pattern\n");
+        return 1;
+    }
+    if (snapshot_dir && container_path) {
+        printf("--snapshot and --container are mutually exclusive\n");
+        return 1;
+    }
+    
+    // More than one PID, or processes picked by name or cgroup: a fleet scan
+    int fleet = !offline && (fleet_names || fleet_cgroup || argc - optind > 1);
+    if (fleet && (launch_target || capture || snapshot_dir || container_path || strings_min ||
+                  entropy_top || candidates_path || narrow_path || references || watch_interval)) {
+        printf("Scanning several processes only searches; --launch-target, --capture,\n"
+               "--snapshot, --container, --strings, --entropy, --candidates, --narrow,\n"
+               "--references and --watch need a single target\n");
+        return 1;
+    }
+    if (watch_interval && (offline || capture || strings_min || entropy_top || narrow_path || refs_only)) {
+        printf("--watch repeats a search on a live target; it cannot be combined with\n"
+               "--offline, --capture, --strings, --entropy, --narrow or --references=ADDR\n");
+        return 1;
+    }
+    if ((offline || !(launch_target || fleet)) && optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    PidList fleet_pids;
+    pid_list_init(&fleet_pids);
+    if (fleet) {
+        int failed = 0;
+        for (int i = optind; i < argc && !failed; i++) failed = pid_list_add(&fleet_pids, atoi(argv[i]));
+        if (!failed && fleet_names) failed = pid_list_add_by_name(&fleet_pids, fleet_names);
+        if (!failed && fleet_cgroup) failed = pid_list_add_cgroup(&fleet_pids, fleet_cgroup);
+        pid_list_finish(&fleet_pids);
+        if (failed || fleet_pids.count == 0) {
+            if (!failed) printf("No processes to scan\n");
+            free(fleet_pids.items);
+            return 1;
+        }
+    }
+    
+    // Load the pattern set before stopping the target
+    PatternSet pattern_set;
+    if (pattern_file) {
+        if (load_pattern_file(pattern_file, &pattern_set) != 0) return 1;
+        printf("Loaded %zu patterns from %s (%zu automaton states)\n",
+               pattern_set.count, pattern_file, pattern_set.state_count);
+    }
+    Regex regex;
+    if (regex_source) {
+        if (regex_compile(&regex, regex_source) != 0) return 1;
+        printf("Searching for regex: %s (%d NFA states, matches up to %zu bytes)\n",
+               regex.source, regex.forward.count, regex.max_len);
+    }
+    if (value_spec) {
+        printf("Searching for %s values %s at %s\n", value.type, value.spec,
+               unaligned ? "every offset" : "aligned addresses");
+    }
+    CandidateSet candidates;
+    if (narrow_path) {
+        if (candidate_set_load(&candidates, narrow_path) != 0) return 1;
+        printf("Loaded %zu %s candidates (%zu bytes each) from %s\n",
+               candidates.total, candidates.type, candidates.width, narrow_path);
+        int numeric = value_type_find(candidates.type, strlen(candidates.type)) >= 0;
+        if ((value_spec && value.width != candidates.width) ||
+            (!numeric && (keep == KEEP_INCREASED || keep == KEEP_DECREASED))) {
+            printf("The test does not fit %s candidates\n", candidates.type);
+            candidate_set_free(&candidates);
+            return 1;
+        }
+    }
+    int literal = !pattern_file && !regex_source && !value_spec && !strings_min && !entropy_top &&
+                  !narrow_path && !refs_only; // A single byte pattern
+    
+    pid_t target_pid = 0;
+    RegionTable regions;
+    MemoryRegion **selected = NULL;
+    int selected_count = 0;
+    MemoryReader reader;
+    OfflineImage image;
+    
+    if (offline) {
+        if (offline_image_load(&image, argv + optind, argc - optind, &regions) != 0) {
+            region_table_free(&regions);
+            return 1;
+        }
+        printf("Loaded %d dumped regions\n", regions.count);
+        selected = malloc((regions.count > 0 ? regions.count : 1) * sizeof(*selected));
+        if (!selected) return 1;
+        selected_count = select_regions(&regions, &policy, selected);
+        printf("Selected %d regions\n", selected_count);
+        memset(&reader, 0, sizeof(reader));
+        reader.backend = READ_BACKEND_OFFLINE;
+        reader.mem_fd = -1;
+        reader.image = &image;
+        printf("Memory read backend: %s\n", read_backend_name(reader.backend));
+    } else if (launch_target) {
+        // Launch the target program
+        printf("Launching target program...\n");
+        pid_t child_pid = fork();
+        
+        if (child_pid == 0) {
+            // Child process - execute target program
+            char *args[] = {"./target_program", NULL};
+            execv(args[0], args);
+            perror("execv");
+            exit(1);
+        } else {
+            target_pid = child_pid;
+            sleep(2); // Give target time to initialize and print its bytes
+        }
+    } else if (!fleet) {
+        target_pid = atoi(argv[optind]);
+    }
+    
+    select_scan_kernel();
+    printf("Pattern scan kernel: %s\n", scan_kernel.name);
+    
+    // Ask for the pattern before the target is stopped
+    if (literal && !pattern_given) {
+        // Ask user for pattern or use auto-mode
+        char choice;
+        printf("Do you want to manually enter the pattern? (y/n): ");
+        scanf(" %c", &choice);
+        
+        if (choice == 'y' || choice == 'Y') {
+            char line[1024];
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF) {} // Rest of the answer line
+            for (;;) {
+                printf("Enter the bytes to search for (hex, space separated; ?? any byte,\n"
+                       "8? or ?8 any nibble, XX/MM bits of MM only): ");
+                if (!fgets(line, sizeof(line), stdin)) return 1;
+                if (parse_search_pattern(line, &pattern) == 0) break;
+                printf("Invalid pattern\n");
+            }
+        } else {
+            // Auto-mode: use a test pattern
+            printf("Auto-mode: using test pattern A-Z\n");
+            char text[3 * AUTO_PATTERN_SIZE + 1];
+            for (int i = 0; i < AUTO_PATTERN_SIZE; i++) {
+                sprintf(text + 3 * i, "%02x ", 0x41 + (i % 26)); // A-Z pattern
+            }
+            if (parse_search_pattern(text, &pattern) != 0) return 1;
+        }
+    }
+    if (literal) {
+        printf("Searching for pattern: ");
+        print_search_pattern(&pattern);
+        printf("\n");
+        if (pattern.mask) {
+            printf("Masked pattern: %zu bytes, anchored on %zu literal bytes at offset %zu\n",
+                   pattern.len, pattern.anchor_len, pattern.anchor_off);
+        }
+        size_t kernel_len = pattern.mask ? pattern.anchor_len : pattern.len;
+        if (scan_kernel_for(kernel_len) != scan_kernel.find) {
+            printf("Using the %s kernel specialized for %zu-byte patterns\n", scan_kernel.name, kernel_len);
+        }
+    }
+    
+    if (fleet) {
+        ScanJob job = {
+            NULL, chunk_size,
+            literal ? &pattern : NULL,
+            pattern_file ? &pattern_set : NULL,
+            regex_source ? &regex : NULL,
+            value_spec ? &value : NULL,
+            1, max_region_bytes, max_total_bytes, 0, 1
+        };
+        long found = fleet_scan(&job, requested_backend, &policy,
+                                pattern_file ? &pattern_set : NULL, &fleet_pids, threads);
+        if (found >= 0) printf("\nTotal occurrences found: %ld\n", found);
+        if (pattern_file) pattern_set_free(&pattern_set);
+        if (regex_source) regex_free(&regex);
+        if (literal) search_pattern_free(&pattern);
+        free(fleet_pids.items);
+        return found >= 0 ? 0 : 1;
+    }
+    
+    double stop_start = 0;
+    int attached = 0;
+    if (!offline) {
+        printf("Attaching to PID: %d\n", target_pid);
+        
+        // Attach to target process
+        stop_start = now_seconds();
+        #ifdef __APPLE__
+        if (ptrace(PT_ATTACH, target_pid, 0, 0) == -1) {
+        #else
+        if (ptrace(PTRACE_ATTACH, target_pid, NULL, NULL) == -1) {
+        #endif
+            perror("ptrace attach");
+            printf("\nIf on macOS, try:\n");
+            printf("  1. Run with sudo: sudo %s %d\n", argv[0], target_pid);
+            printf("  2. Disable SIP (not recommended for security)\n");
+            printf("  3. Use a Linux VM or container\n");
+            return 1;
+        }
+        attached = 1;
+        
+        // Wait for the target to stop
+        int status;
+        waitpid(target_pid, &status, 0);
+        printf("Successfully attached to target process\n");
+        
+        // Read memory regions
+        if (read_memory_regions(target_pid, &regions) != 0) {
+            ptrace(PTRACE_DETACH, target_pid, NULL, NULL);
+            return 1;
+        }
+        printf("Found %d memory regions\n", regions.count);
+        region_table_join_smaps(target_pid, &regions);
+        
+        selected = malloc((regions.count > 0 ? regions.count : 1) * sizeof(*selected));
+        if (!selected) {
+            ptrace(PTRACE_DETACH, target_pid, NULL, NULL);
+            return 1;
+        }
+        selected_count = select_regions(&regions, &policy, selected);
+        size_t rss = 0, anonymous = 0;
+        for (int i = 0; i < selected_count; i++) {
+            rss += selected[i]->rss + selected[i]->swap;
+            anonymous += selected[i]->anonymous;
+        }
+        printf("Selected %d regions (%zu kB resident, %zu kB anonymous)\n",
+               selected_count, rss / 1024, anonymous / 1024);
+        
+        memory_reader_open(&reader, target_pid, requested_backend, regions.items, regions.count);
+        printf("Memory read backend: %s\n", read_backend_name(reader.backend));
+        
+        if (capture) {
+            // Copy everything, let the target go, then work on the copy
+            size_t copied;
+            int captured = capture_regions(&reader, selected, selected_count, &image, &copied);
+            memory_reader_close(&reader);
+            #ifdef __APPLE__
+            ptrace(PT_DETACH, target_pid, 0, 0);
+            #else
+            ptrace(PTRACE_DETACH, target_pid, NULL, NULL);
+            #endif
+            attached = 0;
+            printf("Detached from target process\n");
+            printf("Target stopped for %.3f ms (captured %zu bytes)\n",
+                   (now_seconds() - stop_start) * 1000, copied);
+            if (captured != 0) return 1;
+            
+            reader.backend = READ_BACKEND_OFFLINE;
+            reader.image = &image;
+        }
+    }
+    
+    // ptrace reads only work from the thread that attached
+    if (reader.backend == READ_BACKEND_PTRACE && threads > 1) {
+        printf("ptrace backend: scanning on a single thread\n");
+        threads = 1;
+    }
+    if (strings_min) {
+        printf("Extracting strings of at least %zu characters\n", strings_min);
+    } else if (entropy_top) {
+        printf("Ranking the %zu most random 16- and 32-byte windows\n", entropy_top);
+    } else if (!narrow_path && !refs_only) {
+        printf("Scanning with %d thread%s\n", threads, threads == 1 ? "" : "s");
+    }
+    
+    // Search all memory regions, for the pattern set, the regex or the single pattern
+    ScanJob job = {
+        &reader, chunk_size,
+        literal ? &pattern : NULL,
+        pattern_file ? &pattern_set : NULL,
+        regex_source ? &regex : NULL,
+        value_spec ? &value : NULL,
+        threads, max_region_bytes, max_total_bytes, progress, 0
+    };
+    MatchList matches;
+    if (strings_min) {
+        // Strings are printed as they are found, in region order, and there
+        // are no matches to dump
+        match_list_init(&matches);
+        long found = extract_strings(&reader, selected, selected_count, strings_min, chunk_size,
+                                     max_region_bytes, max_total_bytes);
+        if (found < 0) {
+            printf("Out of memory while extracting strings\n");
+        } else {
+            printf("\nStrings found: %ld\n", found);
+        }
+    } else if (entropy_top) {
+        match_list_init(&matches);
+        if (detect_entropy(&reader, selected, selected_count, entropy_top, chunk_size,
+                           max_region_bytes, max_total_bytes) != 0) {
+            printf("Out of memory while ranking windows\n");
+        }
+    } else if (narrow_path) {
+        // Only the candidates' pages are read; survivors are saved back
+        match_list_init(&matches);
+        if (narrow_candidates(&reader, &regions, &candidates, keep, value_spec ? &value : NULL) != 0) {
+            printf("Out of memory while narrowing candidates\n");
+        } else {
+            if (candidates.total <= NARROW_PRINT_MAX) print_candidates(&candidates, &regions);
+            candidate_set_save(&candidates, candidates_path ? candidates_path : narrow_path);
+        }
+        candidate_set_free(&candidates);
+    } else if (refs_only) {
+        match_list_init(&matches);
+    } else if (scan_regions(&job, selected, selected_count, &matches) != 0) {
+        printf("Out of memory while scanning; results are incomplete\n");
+    }
+    
+    for (size_t i = 0; i < matches.count; i++) {
+        const Match *match = &matches.items[i];
+        print_match(&matches, match, pattern_file ? pattern_set.patterns[match->pattern].label : NULL);
+    }
+    int total_found = (int)matches.count;
+    
+    if (references && (refs_only || matches.count > 0)) {
+        // The first matches are the roots when no addresses were given
+        for (size_t i = 0; !refs_only && i < matches.count && root_count < REFERENCE_MAX_ROOTS; i++) {
+            roots[root_count++] = matches.items[i].addr;
+        }
+        double index_start = now_seconds();
+        ReferenceList index;
+        if (build_reference_index(&reader, &regions, selected, selected_count, chunk_size, threads, &index) != 0) {
+            printf("Out of memory while indexing pointers\n");
+        } else {
+            printf("\nIndexed %zu pointers into writable memory in %.3f s\n",
+                   index.count, now_seconds() - index_start);
+            print_references(&index, &regions, roots, root_count, ref_depth, ref_window);
+            free(index.items);
+        }
+    }
+    
+    if (candidates_path && !narrow_path) {
+        CandidateSet found;
+        candidate_set_init(&found, value_spec ? value.type : "bytes", value_spec ? value.width : pattern.len,
+                           value_spec && !unaligned ? value.width : 1);
+        if (candidate_set_from_matches(&found, &matches) == 0) {
+            candidate_set_save(&found, candidates_path);
+        } else {
+            printf("Out of memory while saving candidates\n");
+        }
+        candidate_set_free(&found);
+    }
+    
+    // Tracking starts from the first scan, while the target is still stopped
+    WatchState watch;
+    int watching = 0;
+    if (watch_interval) {
+        if (watch_begin(&watch, &reader, &job, &policy, pattern_file ? &pattern_set : NULL,
+                        selected, selected_count, &matches) == 0) {
+            watching = 1;
+        } else {
+            printf("Out of memory while starting to watch\n");
+            watch_free(&watch);
+        }
+    }
+    
+    if (pattern_file) print_pattern_hits(&pattern_set, &matches);
+    
+    // The regions holding matches, in address order like the matches
+    MemoryRegion **dump_regions = malloc((matches.count > 0 ? matches.count : 1) * sizeof(*dump_regions));
+    int dump_count = 0;
+    for (size_t i = 0; dump_regions && i < matches.count; i++) {
+        MemoryRegion *region = matches.items[i].region;
+        if (dump_count == 0 || dump_regions[dump_count - 1] != region) dump_regions[dump_count++] = region;
+    }
+    match_list_free(&matches);
+    
+    if (!strings_min && !entropy_top && !narrow_path && !refs_only) printf("\nTotal occurrences found: %d\n", total_found);
+    
+    // Dump the regions where the pattern was found (there is nothing new to
+    // dump when scanning dumps; a capture is dumped from the copy)
+    if (dump_count > 0 && !offline) {
+        printf("\nDumping memory regions where pattern was found...\n");
+        if (container_path) {
+            container_write(container_path, &reader, dump_regions, dump_count);
+        } else if (snapshot_dir) {
+            SnapshotStore store;
+            if (snapshot_store_open(&store, snapshot_dir) == 0) {
+                snapshot_write(&store, &reader, dump_regions, dump_count);
+                snapshot_store_close(&store);
+            }
+        } else {
+            // The index lets --offline put the files back at their addresses
+            FILE *index = fopen(DUMP_INDEX_NAME, "w");
+            if (!index) perror("fopen " DUMP_INDEX_NAME);
+            for (int i = 0; i < dump_count; i++) {
+                MemoryRegion *region = dump_regions[i];
+                char dump_filename[256];
+                sprintf(dump_filename, "dump_region_%d.bin", region->index);
+                dump_memory_region(&reader, region, dump_filename);
+                if (index && region->permissions[0] == 'r') {
+                    dump_index_add(index, dump_filename, region->start, region->end,
+                                   region->permissions, region->pathname);
+                }
+            }
+            if (index) fclose(index);
+        }
+    }
+    free(dump_regions);
+    free(selected);
+    
+    if (attached) {
+        memory_reader_close(&reader);
+        
+        // Detach from target process
+        #ifdef __APPLE__
+        ptrace(PT_DETACH, target_pid, 0, 0);
+        #else
+        ptrace(PTRACE_DETACH, target_pid, NULL, NULL);
+        #endif
+        printf("Detached from target process\n");
+        printf("Target stopped for %.3f ms\n", (now_seconds() - stop_start) * 1000);
+    } else {
+        offline_image_free(&image);
+    }
+    if (watching) {
+        watch_run(&watch, watch_interval);
+        watch_free(&watch);
+    }
+    region_table_free(&regions);
+    if (pattern_file) pattern_set_free(&pattern_set);
+    if (regex_source) regex_free(&regex);
+    if (literal) search_pattern_free(&pattern);
     
     return 0;
 }
\ No newline at end of file